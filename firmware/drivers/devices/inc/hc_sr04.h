@@ -9,6 +9,20 @@
  ** @{ */
 
 /** \brief Driver for reading distance with HC-SR04 module.
+ *
+ * Both edges of the echo pulse are timestamped by an interrupt with the
+ * esp_timer (hardware system timer, 1 us resolution), so the CPU is free
+ * during the flight time. HcSr04Trigger starts a measurement and returns at
+ * once; the blocking functions wait for the echo without using the CPU.
+ *
+ * Several sensors are handled by the scheduler (HcSr04SchedulerStart). Each
+ * sensor is assigned a slot: the sensors of a slot are triggered together, so
+ * only sensors that can not hear each other's pings (e.g. pointing in opposite
+ * directions) should share one. Slots run one after the other, every
+ * slot_us, and when the last one ends the distances of all the sensors are
+ * published at once. A sensor that did not answer within its slot is
+ * published as out of range (or 0 if the echo never started), so the update
+ * rate does not depend on the distances measured.
  *
  * @note Maximun distance: 300cm (118 inches).
  * 
@@ -29,6 +43,8 @@
  * |   Date	    | Description                                    						|
  * |:----------:|:----------------------------------------------------------------------|
  * | 23/10/2023 | Document creation		                         						|
+ * | 19/10/2026 | Echo timed by interrupt, asynchronous measurement			|
+ * | 19/10/2026 | Scheduler for several sensors								|
  * 
  **/
 
@@ -37,8 +53,30 @@
 #include <stdint.h>
 #include "gpio_mcu.h"
 /*==================[macros]=================================================*/
+#define HC_SR04_ECHO_TIMEOUT_US	40000	/*!< The module ends the echo pulse after about 38 ms without obstacle */
+#define HC_SR04_MAX_SENSORS		8		/*!< Sensors handled by the scheduler */
+#define HC_SR04_SLOT_MIN_US		25000	/*!< Shortest slot: round trip at 300 cm plus the decay of the ping */
 
 /*==================[typedef]================================================*/
+/**
+ * @brief Sensor handled by the scheduler
+ */
+typedef struct {
+	gpio_t echo;				/*!< GPIO where the echo pin is connected */
+	gpio_t trigger;				/*!< GPIO where the trigger pin is connected */
+	uint8_t slot;				/*!< Sensors with the same slot are triggered together */
+} hc_sr04_sensor_t;
+
+/**
+ * @brief Scheduler configuration struct
+ */
+typedef struct {
+	const hc_sr04_sensor_t *sensors;	/*!< Sensors, distances are published in this order */
+	uint8_t n_sensors;					/*!< Number of sensors, up to HC_SR04_MAX_SENSORS */
+	uint32_t slot_us;					/*!< Slot length (in us), at least HC_SR04_SLOT_MIN_US */
+	void *func_p;						/*!< Function called (from the esp_timer task) each time the distances are published, NULL for none */
+	void *param_p;						/*!< Parameter of func_p */
+} hc_sr04_scheduler_t;
 
 /*==================[external data declaration]==============================*/
 
@@ -52,9 +90,41 @@
  */
 bool HcSr04Init(gpio_t echo, gpio_t trigger);
 
+/**
+ * @brief Starts a measurement and returns without waiting for the echo
+ * 
+ * @param func_p function called from the echo interrupt when the measurement ends, NULL for none
+ * @param param_p parameter of func_p
+ * @return false if the previous measurement is still in progress
+ */
+bool HcSr04Trigger(void *func_p, void *param_p);
+
+/**
+ * @brief Echo pulse width of the last measurement
+ * 
+ * @return uint32_t pulse width in us, 0 if there was no echo
+ */
+uint32_t HcSr04GetEchoUs(void);
+
+/**
+ * @brief Distance of the last measurement, without waiting
+ * 
+ * @return uint16_t distance in cm.
+ */
+uint16_t HcSr04GetDistanceInCentimeters(void);
+
+/**
+ * @brief Distance of the last measurement, without waiting
+ * 
+ * @return uint16_t distance in inches.
+ */
+uint16_t HcSr04GetDistanceInInches(void);
+
 /**
  * @brief Read distance
  * 
+ * Triggers a measurement and waits for the echo (the calling task sleeps).
+ * 
  * @return uint16_t measured distance in cm.
  */
 uint16_t HcSr04ReadDistanceInCentimeters(void);
@@ -62,10 +132,51 @@ uint16_t HcSr04ReadDistanceInCentimeters(void);
 /**
  * @brief Read distance
  * 
+ * Triggers a measurement and waits for the echo (the calling task sleeps).
+ * 
  * @return uint16_t measured distance in inches.
  */
 uint16_t HcSr04ReadDistanceInInches(void);
 
+/**
+ * @brief Starts measuring several sensors periodically
+ * 
+ * The sensors are initialized here, HcSr04Init is not needed. The single
+ * sensor functions must not be used while the scheduler runs.
+ * 
+ * @param config scheduler configuration
+ * @return false if the configuration is not valid
+ */
+bool HcSr04SchedulerStart(const hc_sr04_scheduler_t *config);
+
+/**
+ * @brief Stops the scheduler
+ */
+void HcSr04SchedulerStop(void);
+
+/**
+ * @brief Time between two publications of the distances
+ * 
+ * @return uint32_t period in us (number of slots * slot_us)
+ */
+uint32_t HcSr04SchedulerGetPeriod(void);
+
+/**
+ * @brief Last published distances
+ * 
+ * @param distances container for n_sensors distances in cm
+ * @return uint32_t number of publications since the start, to tell new data from old
+ */
+uint32_t HcSr04SchedulerGetDistancesInCentimeters(uint16_t *distances);
+
+/**
+ * @brief Last published distances
+ * 
+ * @param distances container for n_sensors distances in inches
+ * @return uint32_t number of publications since the start, to tell new data from old
+ */
+uint32_t HcSr04SchedulerGetDistancesInInches(uint16_t *distances);
+
 /**
  * @brief HC_SR04 de-initialization.
  * 
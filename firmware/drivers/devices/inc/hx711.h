@@ -17,14 +17,48 @@
  * |   Date	    | Description                                    						|
  * |:----------:|:----------------------------------------------------------------------|
  * | 30/01/2024 | Document creation		                         						|
+ * | 19/10/2026 | Fixed gain pulses and conversion, interrupt driven reading			|
+ * | 19/10/2026 | Streaming weight filter, HX711_getValue/HX711_getUnits names fixed	|
  * 
  **/
 
 /*==================[inclusions]=============================================*/
+#include <stdbool.h>
 #include <gpio_mcu.h>
 /*==================[macros]=================================================*/
+#define HX711_QUEUE_LENGTH	16		/*!< Readings held by the queue of the interrupt driven mode */
+#define HX711_MEDIAN_SIZE	5		/*!< Readings of the moving median (odd) */
+#define HX711_STEP_CONFIRM	2		/*!< Consecutive readings past the step threshold that make a load change */
+
+#define HX711_EVENT_STEP	0x01	/*!< Load change detected, the filter was restarted from the new value */
+#define HX711_EVENT_SETTLED	0x02	/*!< Weight settled after a load change (or after HX711_filterInit) */
 
 /*==================[typedef]================================================*/
+/**
+ * @brief Reading delivered by the interrupt driven mode
+ */
+typedef struct {
+	int32_t value;				/*!< Signed 24 bit conversion result */
+	int64_t timestamp_us;		/*!< Time DOUT went low (esp_timer time base) */
+} hx711_reading_t;
+
+/**
+ * @brief Streaming weight filter: moving median, exponential smoother and
+ * step detection, updated once per reading
+ */
+typedef struct {
+	int32_t window[HX711_MEDIAN_SIZE];	/*!< Last readings, for the median */
+	uint8_t pos;				/*!< Next position of window */
+	int64_t smooth;				/*!< Exponential smoother output (counts, Q8) */
+	uint8_t shift;				/*!< Smoother factor: 1 / 2^shift */
+	int32_t step;				/*!< Step threshold (counts) */
+	int32_t band;				/*!< Settling band (counts) */
+	uint8_t settle_readings;	/*!< Readings inside the band to settle */
+	uint8_t step_count;			/*!< Consecutive readings past the step threshold */
+	int8_t step_sign;			/*!< Side of those readings */
+	uint8_t stable_count;		/*!< Consecutive readings inside the band */
+	bool settled;				/*!< Weight settled since the last load change */
+} hx711_filter_t;
 
 /*==================[external data declaration]==============================*/
 
@@ -53,10 +87,35 @@ void HX711_setGain(uint8_t gain);
 
 /** @fn HX711_read(void)
  * @brief Waits for the chip to be ready and returns a reading
- * @return Read value
+ * The calling task sleeps while the conversion is in progress (up to 100 ms
+ * at 10 SPS). Must not be used while the interrupt driven mode is running.
+ * @return Read value, offset binary (signed value + 0x800000)
  */
 uint32_t HX711_read(void);
 
+/** @fn HX711_intStart(void)
+ * @brief Starts the interrupt driven mode
+ * Each falling edge of DOUT (conversion ready) triggers an interrupt that
+ * clocks out the result and the gain pulses (about 40 us of CPU) and sends
+ * it to a queue of HX711_QUEUE_LENGTH readings. When the queue is full the
+ * new reading is discarded.
+ * @return true if the queue could be created
+ */
+bool HX711_intStart(void);
+
+/** @fn HX711_intStop(void)
+ * @brief Stops the interrupt driven mode
+ */
+void HX711_intStop(void);
+
+/** @fn HX711_getReading(hx711_reading_t *reading, uint32_t timeout_ms)
+ * @brief Gets the oldest reading of the interrupt driven mode
+ * @param[out] reading Container for the reading
+ * @param[in] timeout_ms Time to wait for a reading, 0 to return at once
+ * @return true if there was a reading
+ */
+bool HX711_getReading(hx711_reading_t *reading, uint32_t timeout_ms);
+
 // returns an average reading; times = how many times to read
 /** @fn HX711_readAverage(uint8_t times)
  * @brief Returns an average reading
@@ -65,20 +124,20 @@ uint32_t HX711_read(void);
  */
 uint32_t HX711_readAverage(uint8_t times);
 
-/** @fn HX711_get_value(uint8_t times)
+/** @fn HX711_getValue(uint8_t times)
  * @brief Returns (read_average() - OFFSET), that is the current value without the tare weight
  * @param[in] times How many times to read
  * @return Read value
  */
-double HX711_get_value(uint8_t times);
+double HX711_getValue(uint8_t times);
 
 
-/** @fn HX711_get_units(uint8_t times)
+/** @fn HX711_getUnits(uint8_t times)
  * @brief Returns get_value() divided by SCALE, that is the raw value divided by a value obtained via calibration
  * @param[in] times How many readings to do
  * @return Read value
  */
-float HX711_get_units(uint8_t times);
+float HX711_getUnits(uint8_t times);
 
 /** @fn HX711_tare(uint8_t times)
  * @brief Set the OFFSET value for tare weight
@@ -110,6 +169,44 @@ void HX711_setOffset(double offset);
  */
 double HX711_getOffset(void);
 
+/** @fn HX711_filterInit(hx711_filter_t *filter, uint8_t shift, int32_t step, int32_t band, uint8_t settle_readings)
+ * @brief Initializes a streaming weight filter
+ * Each reading goes through a moving median of HX711_MEDIAN_SIZE (removes
+ * spikes) and an exponential smoother. HX711_STEP_CONFIRM consecutive readings
+ * further than step from the smoothed value, on the same side, are a load
+ * change: the filter restarts from the new reading instead of slowly
+ * converging to it. The weight is settled when settle_readings consecutive
+ * medians stay within band of the smoothed value.
+ * @param[out] filter Filter
+ * @param[in] shift Smoother factor 1 / 2^shift (3: time constant of 8 readings)
+ * @param[in] step Step threshold, in counts (SCALE counts per unit)
+ * @param[in] band Settling band, in counts
+ * @param[in] settle_readings Readings inside the band to settle
+ */
+void HX711_filterInit(hx711_filter_t *filter, uint8_t shift, int32_t step, int32_t band, uint8_t settle_readings);
+
+/** @fn HX711_filterUpdate(hx711_filter_t *filter, int32_t value)
+ * @brief Processes a reading
+ * @param[in,out] filter Filter
+ * @param[in] value Signed reading (hx711_reading_t value)
+ * @return Events produced by this reading (HX711_EVENT_STEP, HX711_EVENT_SETTLED)
+ */
+uint8_t HX711_filterUpdate(hx711_filter_t *filter, int32_t value);
+
+/** @fn HX711_filterValue(const hx711_filter_t *filter)
+ * @brief Filtered reading
+ * @param[in] filter Filter
+ * @return Filtered signed reading, in counts
+ */
+int32_t HX711_filterValue(const hx711_filter_t *filter);
+
+/** @fn HX711_filterUnits(const hx711_filter_t *filter)
+ * @brief Filtered weight: (filtered reading - OFFSET) / SCALE
+ * @param[in] filter Filter
+ * @return Weight in the units of SCALE
+ */
+float HX711_filterUnits(const hx711_filter_t *filter);
+
 /** @fn HX711_powerDown(void)
  * @brief Puts the chip into power down mode
  */
@@ -120,10 +217,6 @@ void HX711_powerDown(void);
  */
 void HX711_powerUp(void);
 
-/*==================[internal functions declaration]=========================*/
-// Sends/receives data. 
-uint8_t shiftIn(void);
-
 /** @} doxygen end group definition */
 /** @} doxygen end group definition */
 /** @} doxygen end group definition */
@@ -33,11 +33,13 @@
  * |   Date	    | Description                                    |
  * |:----------:|:-----------------------------------------------|
  * | 18/01/2024 | Document creation		                         |
+ * | 19/10/2026 | Commands and data queued, D/C set by the SPI driver |
  *
  */
 
 /*==================[inclusions]=============================================*/
 #include <stdint.h>
+#include <stdbool.h>
 #include "spi_mcu.h"
 #include "fonts.h"
 /*==================[macros]=================================================*/
@@ -45,6 +47,7 @@
 #define ILI9341_WIDTH       240			/*!< LCD width in pixels */
 #define ILI9341_HEIGHT      320			/*!< LCD height in pixels */
 #define ILI9341_PIXEL_MAX	76800
+#define ILI9341_TEXT_MAX_LEN	16		/*!< Maximum number of characters of a text widget */
 /* Colors */							/*	 R,   G,   B */
 #define ILI9341_BLACK          	0x0000  /*   0,   0,   0 */
 #define ILI9341_NAVY           	0x000F 	/*   0,   0, 128 */
@@ -79,6 +82,37 @@ typedef enum ili9341_orientation {
 	ILI9341_Landscape_1, 	/*!< Landscape orientation mode 1 */
 	ILI9341_Landscape_2  	/*!< Landscape orientation mode 2 */
 } ili9341_orientation_t;
+
+/**
+ * @brief  Retained text widget
+ *
+ * Remembers the text currently shown on the LCD, so an update only redraws
+ * the character cells that changed.
+ */
+typedef struct {
+	uint16_t x;								/*!< X position of top left corner */
+	uint16_t y;								/*!< Y position of top left corner */
+	Font_t *font;							/*!< Font used to draw the text */
+	uint16_t foreground;					/*!< Color for text */
+	uint16_t background;					/*!< Color for text background */
+	char text[ILI9341_TEXT_MAX_LEN + 1];	/*!< Text currently displayed */
+	bool valid;								/*!< false when the LCD content is unknown */
+} ili9341_text_t;
+
+/**
+ * @brief  Reader of a RLE compressed picture
+ *
+ * The stream is a sequence of packets, each one starting with a control byte c:
+ * if c & 0x80 the next pixel (2 bytes, high byte first) is repeated (c & 0x7F) + 1
+ * times, else the next c + 1 pixels follow uncompressed. Pictures can be packed
+ * with firmware/tools/img_pack.py.
+ */
+typedef struct {
+	const uint8_t *data;	/*!< Next byte of the compressed stream */
+	uint8_t count;			/*!< Pixels left in the current packet */
+	bool run;				/*!< true if the current packet is a run */
+	uint16_t color;			/*!< Color of the current run */
+} ili9341_rle_t;
 /*==================[external data declaration]==============================*/
 
 /*==================[external functions declaration]=========================*/
@@ -114,6 +148,32 @@ void ILI9341Fill(uint16_t color);
  */
 void ILI9341Rotate(ili9341_orientation_t orientation);
 
+/**
+ * @brief  		Defines the hardware scrolling area
+ * @note		Scrolling works on the 320 lines of the frame memory, that is the
+ * 				LCD rows in portrait orientation and the LCD columns in landscape.
+ * 				top_fixed + scroll_height + bottom_fixed must be ILI9341_HEIGHT.
+ * @param[in]	top_fixed: Lines of the fixed area before the scrolling one
+ * @param[in]	scroll_height: Lines of the scrolling area
+ * @param[in]	bottom_fixed: Lines of the fixed area after the scrolling one
+ * @retval 		None
+ */
+void ILI9341SetScrollArea(uint16_t top_fixed, uint16_t scroll_height, uint16_t bottom_fixed);
+
+/**
+ * @brief  		Scrolls the scrolling area
+ * @param[in]	line: Frame memory line to show at the start of the scrolling area
+ * 				(between top_fixed and top_fixed + scroll_height - 1)
+ * @retval 		None
+ */
+void ILI9341Scroll(uint16_t line);
+
+/**
+ * @brief  		Leaves scroll mode, frame memory is shown as written
+ * @retval 		None
+ */
+void ILI9341ScrollStop(void);
+
 /**
  * @brief  		Draw a single character on the LCD
  * @param[in]  	x: X position of top left corner
@@ -161,6 +221,47 @@ void ILI9341DrawString(uint16_t x, uint16_t y, char* str, Font_t *font, uint16_t
  */
 void ILI9341GetStringSize(char* str, Font_t* font, uint16_t* width, uint16_t* height);
 
+/**
+ * @brief  		Initializes a retained text widget
+ * @note		Nothing is drawn until the first call to ILI9341TextUpdate()
+ * @param[out] 	widget: Widget to initialize
+ * @param[in]  	x: X position of top left corner of first character
+ * @param[in]  	y: Y position of top left corner of first character
+ * @param[in]  	font: Pointer to used font
+ * @param[in]  	foreground: Color for text
+ * @param[in]  	background: Color for text background
+ * @retval 		None
+ */
+void ILI9341TextInit(ili9341_text_t *widget, uint16_t x, uint16_t y, Font_t *font, uint16_t foreground, uint16_t background);
+
+/**
+ * @brief  		Updates the text shown by a widget
+ * @note		Only the characters that differ from the displayed ones are drawn,
+ * 				so updating with the same text doesn't write to the LCD.
+ * 				Text longer than ILI9341_TEXT_MAX_LEN is truncated.
+ * @param[in] 	widget: Widget to update
+ * @param[in]  	str: New text (single line)
+ * @retval 		None
+ */
+void ILI9341TextUpdate(ili9341_text_t *widget, const char *str);
+
+/**
+ * @brief  		Updates a widget with an integer, like ILI9341DrawInt()
+ * @param[in] 	widget: Widget to update
+ * @param[in] 	num: Number to be displayed
+ * @param[in] 	dig: Number of digits to display
+ * @retval 		None
+ */
+void ILI9341TextUpdateInt(ili9341_text_t *widget, uint32_t num, uint8_t dig);
+
+/**
+ * @brief  		Forces a full redraw of the widget on its next update
+ * @note		Call it after drawing over the widget area (e.g. after ILI9341Fill())
+ * @param[in] 	widget: Widget to invalidate
+ * @retval 		None
+ */
+void ILI9341TextInvalidate(ili9341_text_t *widget);
+
 /**
  * @brief  		Draws line on the LCD
  * @param[in]  	x0: X coordinate of starting point
@@ -254,6 +355,63 @@ void ILI9341DrawFilledTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, i
  */
 void ILI9341DrawPicture(uint16_t x, uint16_t y, uint16_t width, uint16_t hieght, const uint8_t* pic);
 
+/**
+ * @brief  		Opens a window of the LCD to write pixels with ILI9341WindowWrite
+ * @note		Pixels fill the window left to right, top to bottom.
+ * @param[in] 	x0: Start column
+ * @param[in]  	y0: Start row
+ * @param[in] 	x1: End column
+ * @param[in]  	y1: End row
+ * @retval 		None
+ */
+void ILI9341WindowBegin(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
+
+/**
+ * @brief  		Writes pixels to the window opened by ILI9341WindowBegin
+ * @note		data can be reused when the function returns.
+ * @param[in] 	data: Pixels, 2 bytes per pixel (high byte first), in RAM
+ * @param[in]  	bytes: Number of bytes to write
+ * @retval 		None
+ */
+void ILI9341WindowWrite(uint8_t *data, uint32_t bytes);
+
+/**
+ * @brief  		Waits until everything sent to the LCD has been transferred
+ * @note		Drawing functions queue their commands and data on the SPI
+ * 				port and may return before the transfer ends. Call this
+ * 				before timing a drawing or sharing the SPI port.
+ * @retval 		None
+ */
+void ILI9341Wait(void);
+
+/**
+ * @brief  		Draw a RLE compressed picture on the LCD
+ * @note		The picture is expanded while it is sent, without decoding it
+ * 				to RAM first. See ili9341_rle_t for the format.
+ * @param[in] 	x: X position of top left corner of picture
+ * @param[in]  	y: Y position of top left corner of picture
+ * @param[in] 	width: Picture width in pixels
+ * @param[in]  	height: Picture height in pixels
+ * @param[in]  	rle: Pointer to first byte of the compressed picture
+ * @retval 		None
+ */
+void ILI9341DrawRlePicture(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t* rle);
+
+/**
+ * @brief  		Starts reading a RLE compressed picture
+ * @param[in] 	rle: Reader to initialize
+ * @param[in]  	data: Pointer to first byte of the compressed picture
+ * @retval 		None
+ */
+void ILI9341RleInit(ili9341_rle_t *rle, const uint8_t *data);
+
+/**
+ * @brief  		Reads the next pixel of a RLE compressed picture
+ * @param[in] 	rle: Reader of the picture
+ * @retval 		Pixel color
+ */
+uint16_t ILI9341RleNext(ili9341_rle_t *rle);
+
 /**
  * @brief  	De-initializes ILI9341 LCD
  * @param	None
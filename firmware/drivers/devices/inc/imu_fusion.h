@@ -0,0 +1,114 @@
+#ifndef IMU_FUSION_H
+#define IMU_FUSION_H
+
+/** \addtogroup Drivers_Programable Drivers Programable
+ ** @{ */
+/** \addtogroup Drivers_Devices Drivers devices
+ ** @{ */
+/** \addtogroup IMU_Fusion IMU Fusion
+ ** @{ */
+
+/** \brief Orientation estimation from accelerometer and gyroscope data.
+ *
+ * Mahony complementary filter in fixed point: the gyroscope is integrated
+ * into a quaternion, and the error between the measured and the estimated
+ * gravity direction is fed back through a PI controller. The ESP32-C6 has no
+ * FPU, so the update uses only integer arithmetic (quaternion in Q30, angular
+ * rates in Q24) and runs at the full sample rate of the MPU6050 FIFO.
+ *
+ * The inputs are raw MPU6050 counts. Euler angles are computed from the
+ * quaternion only when requested.
+ *
+ * firmware/tools/imu_fusion_bench.c measures the update on the host and checks
+ * it against a floating point implementation.
+ *
+ * @author Joaquin Palacio
+ *
+ * @section changelog
+ *
+ * |   Date	    | Description                                    						|
+ * |:----------:|:----------------------------------------------------------------------|
+ * | 19/10/2026 | Document creation		                         						|
+ *
+ **/
+
+/*==================[inclusions]=============================================*/
+#include <stdint.h>
+/*==================[macros]=================================================*/
+#define IMU_FUSION_KP		0.5f	/*!< Default proportional gain (Mahony twoKp / 2) */
+#define IMU_FUSION_KI		0.0f	/*!< Default integral gain (Mahony twoKi / 2) */
+
+/*==================[typedef]================================================*/
+/**
+ * @brief Fusion filter state
+ */
+typedef struct {
+	int32_t q[4];				/*!< Orientation quaternion w, x, y, z (Q30) */
+	int32_t e_int[3];			/*!< Integral feedback (rad/s, Q24) */
+	int32_t gyro_scale;			/*!< rad/s per gyroscope count (Q24) */
+	uint32_t half_dt;			/*!< Half the sample period (s, Q32) */
+	int32_t two_kp;				/*!< Proportional gain times 2 (Q16) */
+	int32_t two_ki_dt;			/*!< Integral gain times 2 times the sample period (Q32) */
+	uint32_t updates;			/*!< Samples processed */
+} imu_fusion_t;
+
+/**
+ * @brief Euler angles (aerospace sequence: yaw, pitch, roll)
+ */
+typedef struct {
+	int16_t roll;				/*!< Rotation around X, hundredths of degree (-18000 to 18000) */
+	int16_t pitch;				/*!< Rotation around Y, hundredths of degree (-9000 to 9000) */
+	int16_t yaw;				/*!< Rotation around Z, hundredths of degree (-18000 to 18000) */
+} imu_euler_t;
+
+/*==================[external data declaration]==============================*/
+
+/*==================[external functions declaration]=========================*/
+/**
+ * @brief Initializes a fusion filter with the identity orientation
+ *
+ * @param fusion filter
+ * @param rate_hz sample rate of the data to process
+ * @param gyro_range gyroscope full scale (MPU6050_GYRO_FS_250 to MPU6050_GYRO_FS_2000)
+ * @param kp proportional gain (IMU_FUSION_KP)
+ * @param ki integral gain (IMU_FUSION_KI)
+ */
+void ImuFusionInit(imu_fusion_t *fusion, uint16_t rate_hz, uint8_t gyro_range, float kp, float ki);
+
+/**
+ * @brief Processes one sample
+ *
+ * @param fusion filter
+ * @param accel raw accelerometer X, Y, Z (any full scale)
+ * @param gyro raw gyroscope X, Y, Z
+ */
+void ImuFusionUpdate(imu_fusion_t *fusion, const int16_t accel[3], const int16_t gyro[3]);
+
+/**
+ * @brief Processes a batch of samples
+ *
+ * Each sample holds 6 consecutive int16_t: accel X, Y, Z, gyro X, Y, Z. For
+ * samples read with MPU6050_fifoGetSample:
+ * ImuFusionUpdateBatch(&fusion, &samples[0].ax, n, sizeof(mpu6050_sample_t))
+ *
+ * @param fusion filter
+ * @param axes accel X of the first sample
+ * @param n number of samples
+ * @param stride bytes from one sample to the next
+ */
+void ImuFusionUpdateBatch(imu_fusion_t *fusion, const int16_t *axes, uint16_t n, uint16_t stride);
+
+/**
+ * @brief Euler angles of the current orientation
+ *
+ * @param fusion filter
+ * @param euler container for the angles
+ */
+void ImuFusionGetEuler(const imu_fusion_t *fusion, imu_euler_t *euler);
+
+/*==================[end of file]============================================*/
+#endif /* #ifndef IMU_FUSION_H */
+
+/** @} doxygen end group definition */
+/** @} doxygen end group definition */
+/** @} doxygen end group definition */
@@ -17,11 +17,18 @@
  * |   Date	| Description                                    			|
  * |:----------:|:----------------------------------------------------------------------|
  * | 30/01/2024 | Document creation		                         		|
+ * | 19/10/2026 | Configuration registers cached (see I2C_shadowEnable)	|
+ * | 19/10/2026 | FIFO acquisition with timestamped samples			|
+ * | 19/10/2026 | Data ready interrupt driven acquisition task			|
+ * | 19/10/2026 | DMP firmware load and FIFO packets (MPU6050_dmpStart)	|
+ * | 19/10/2026 | Magnetometer on the auxiliary I2C bus (MPU6050_magStart)	|
+ * | 19/10/2026 | Offset registers, calibration and offsets in NVS		|
  * 
  **/
 
 /*==================[inclusions]=============================================*/
 #include "i2c_mcu.h"
+#include "mpu6050_dmp.h"
 /*==================[macros]=================================================*/
 #undef pgm_read_byte
 #define pgm_read_byte(addr) (*(const unsigned char *)(addr))
@@ -409,9 +416,63 @@
 #define MPU6050_DMP_MEMORY_CHUNK_SIZE   16
 // note: DMP code memory blocks defined at end of header file
 
+#define MPU6050_FIFO_SIZE           1024    /*!< Bytes of the MPU6050 FIFO */
+#define MPU6050_FIFO_RECORD         12      /*!< Bytes of a FIFO record: accel X, Y, Z, gyro X, Y, Z */
+#define MPU6050_FIFO_BATCH          32      /*!< Records read from the FIFO in a single burst */
+#define MPU6050_SAMPLE_BUFFER       128     /*!< Samples in the acquisition ring buffer */
+#define MPU6050_TASK_STACK          3072    /*!< Stack of the interrupt driven acquisition task */
+#define MPU6050_CALIB_SAMPLES       2000    /*!< Samples averaged by each calibration round (2 s at 1 kHz) */
+#define MPU6050_CALIB_ROUNDS        2       /*!< Calibration rounds, each one corrects what is left by the previous */
+#define MPU6050_NVS_NAMESPACE       "mpu6050"   /*!< NVS namespace of the stored offsets */
+#define MPU6050_MOTION9_LENGTH      20      /*!< ACCEL_XOUT_H to EXT_SENS_DATA_05: accel, temp, gyro, magnetometer */
+
 /*==================[typedef]================================================*/
+/**
+ * @brief IMU sample acquired from the FIFO
+ */
+typedef struct {
+	int64_t timestamp_us;		/*!< Estimated sampling time (esp_timer time base) */
+	int16_t ax, ay, az;			/*!< Raw accelerometer */
+	int16_t gx, gy, gz;			/*!< Raw gyroscope */
+} mpu6050_sample_t;
+
+/**
+ * @brief FIFO acquisition statistics
+ */
+typedef struct {
+	uint32_t samples;			/*!< Samples read from the FIFO */
+	uint32_t batches;			/*!< Burst reads of the FIFO */
+	uint32_t overflows;			/*!< FIFO overflows (FIFO reset and data lost) */
+	uint32_t dropped;			/*!< Samples lost because the ring buffer was full */
+	uint32_t wakeups;			/*!< Wakeups of the acquisition task (MPU6050_intStart) */
+	uint32_t latency_last_us;	/*!< Time from the INT edge to the samples published, last wakeup */
+	uint32_t latency_max_us;	/*!< Longest latency */
+	uint64_t latency_total_us;	/*!< Sum of latencies (average: latency_total_us / wakeups) */
+} mpu6050_fifo_stats_t;
+
+/**
+ * @brief Offset registers
+ */
+typedef struct {
+	int16_t accel[3];			/*!< XA_OFFS to ZA_OFFS: +-16 g scale, bit 0 reserved */
+	int16_t gyro[3];			/*!< XG_OFFS_USR to ZG_OFFS_USR: +-1000 dps scale */
+} mpu6050_offsets_t;
+
+/**
+ * @brief Magnetometer connected to the auxiliary I2C bus, read by slave 0
+ */
+typedef struct {
+	uint8_t address;			/*!< 7 bit I2C address */
+	uint8_t data_reg;			/*!< First of the 6 data registers */
+	uint8_t axis[3];			/*!< Word (0 to 2) of the data registers holding X, Y and Z */
+	bool little_endian;			/*!< Data words are LSB first (swapped by the MPU6050) */
+	const uint8_t *init;		/*!< Register, value pairs written at start, NULL for none */
+	uint8_t init_pairs;			/*!< Pairs in init */
+} mpu6050_mag_t;
 
 /*==================[external data declaration]==============================*/
+extern const mpu6050_mag_t mpu6050_mag_hmc5883l;	/*!< HMC5883L (GY-87 boards): 75 Hz, +-1.3 Ga, continuous */
+extern const mpu6050_mag_t mpu6050_mag_qmc5883l;	/*!< QMC5883L: 200 Hz, +-8 G, continuous */
 
 /*==================[external functions declaration]=========================*/
 /** Specific address constructor.
@@ -1818,7 +1879,9 @@ bool MPU6050_getIntDataReadyStatus();
 
 // ACCEL_*OUT_* registers
 /** Get raw 9-axis motion sensor readings (accel/gyro/compass).
- * FUNCTION NOT FULLY IMPLEMENTED YET.
+ * All nine axes come from a single MPU6050_MOTION9_LENGTH bytes burst read:
+ * the magnetometer is read by the MPU6050 into EXT_SENS_DATA at the sample
+ * rate (see MPU6050_magStart). Without a magnetometer mx, my and mz are 0.
  * @param ax 16-bit signed integer container for accelerometer X-axis value
  * @param ay 16-bit signed integer container for accelerometer Y-axis value
  * @param az 16-bit signed integer container for accelerometer Z-axis value
@@ -1835,6 +1898,21 @@ bool MPU6050_getIntDataReadyStatus();
  */
 void MPU6050_getMotion9(int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int16_t* gy, int16_t* gz, int16_t* mx, int16_t* my, int16_t* mz);
 
+/** Start reading a magnetometer through the auxiliary I2C bus.
+ * The magnetometer is configured in bypass mode (its init pairs are written
+ * directly by the ESP32), then slave 0 is set to read its 6 data registers
+ * into EXT_SENS_DATA_00 to 05 at the sample rate, with the I2C master at
+ * 400 kHz.
+ * @param mag Magnetometer description (mpu6050_mag_hmc5883l, mpu6050_mag_qmc5883l)
+ * @return true if the magnetometer acknowledged its configuration
+ */
+bool MPU6050_magStart(const mpu6050_mag_t *mag);
+
+/** Stop reading the magnetometer.
+ * Disables slave 0 and the I2C master.
+ */
+void MPU6050_magStop();
+
 /** Get raw 6-axis motion sensor readings (accel/gyro).
  * Retrieves all currently available motion sensor values.
  * @param ax 16-bit signed integer container for accelerometer X-axis value
@@ -2363,6 +2441,27 @@ void MPU6050_resetI2CMaster();
  */
 void MPU6050_resetSensors();
 
+/** Get DMP enabled status.
+ * @return Current DMP enabled status
+ * @see MPU6050_RA_USER_CTRL
+ * @see MPU6050_USERCTRL_DMP_EN_BIT
+ */
+bool MPU6050_getDMPEnabled();
+
+/** Set DMP enabled status.
+ * @param enabled New DMP enabled status
+ * @see MPU6050_RA_USER_CTRL
+ * @see MPU6050_USERCTRL_DMP_EN_BIT
+ */
+void MPU6050_setDMPEnabled(bool enabled);
+
+/** Reset the DMP.
+ * This bit automatically clears to 0 after the reset has been triggered.
+ * @see MPU6050_RA_USER_CTRL
+ * @see MPU6050_USERCTRL_DMP_RESET_BIT
+ */
+void MPU6050_resetDMP();
+
 // PWR_MGMT_1 register
 /** Trigger a full device reset.
  * A small delay of ~50ms may be desirable after triggering a reset.
@@ -2669,6 +2768,258 @@ uint8_t MPU6050_getDeviceID();
  */
 void MPU6050_setDeviceID(uint8_t id);
 
+// BANK_SEL register
+/** Select the DMP memory bank accessed through MEM_R_W.
+ * @param bank Memory bank (0 to MPU6050_DMP_MEMORY_BANKS - 1)
+ * @param prefetchEnabled Prefetch enabled status
+ * @param userBank Access the user bank instead of the memory bank
+ * @see MPU6050_RA_BANK_SEL
+ */
+void MPU6050_setMemoryBank(uint8_t bank, bool prefetchEnabled, bool userBank);
+
+// MEM_START_ADDR register
+/** Set the address, inside the selected bank, of the next MEM_R_W access.
+ * The address is incremented after each byte read or written.
+ * @param address Start address
+ * @see MPU6050_RA_MEM_START_ADDR
+ */
+void MPU6050_setMemoryStartAddress(uint8_t address);
+
+// MEM_R_W register
+/** Read a block of DMP memory.
+ * The block can cross bank boundaries.
+ * @param data Container for the data
+ * @param dataSize Bytes to read
+ * @param bank First memory bank
+ * @param address Address inside the first bank
+ * @return true if every transfer succeeded
+ * @see MPU6050_RA_MEM_R_W
+ */
+bool MPU6050_readMemoryBlock(uint8_t *data, uint16_t dataSize, uint8_t bank, uint8_t address);
+
+/** Write a block of DMP memory.
+ * Written in MPU6050_DMP_MEMORY_CHUNK_SIZE bursts, which never cross a bank
+ * boundary.
+ * @param data Data to write
+ * @param dataSize Bytes to write
+ * @param bank First memory bank
+ * @param address Address inside the first bank
+ * @param verify Read back each chunk and compare it
+ * @return true if every transfer succeeded (and matched, with verify)
+ * @see MPU6050_RA_MEM_R_W
+ */
+bool MPU6050_writeMemoryBlock(const uint8_t *data, uint16_t dataSize, uint8_t bank, uint8_t address, bool verify);
+
+// DMP_CFG_1, DMP_CFG_2 registers
+/** Set the DMP program start address.
+ * @param address Start address (MPU6050_DMP_START_ADDRESS for the MotionApps images)
+ * @see MPU6050_RA_DMP_CFG_1
+ */
+void MPU6050_setDMPStartAddress(uint16_t address);
+
+// XA_OFFS_*, XG_OFFS_USR* registers
+/** Get X-axis accelerometer offset.
+ * @return Current offset, added by the MPU6050 to the X-axis accelerometer output
+ * @see MPU6050_RA_XA_OFFS_H
+ */
+int16_t MPU6050_getXAccelOffset();
+
+/** Set X-axis accelerometer offset.
+ * @param offset New offset
+ * @see MPU6050_RA_XA_OFFS_H
+ */
+void MPU6050_setXAccelOffset(int16_t offset);
+
+/** Get Y-axis accelerometer offset.
+ * @return Current offset, added by the MPU6050 to the Y-axis accelerometer output
+ * @see MPU6050_RA_YA_OFFS_H
+ */
+int16_t MPU6050_getYAccelOffset();
+
+/** Set Y-axis accelerometer offset.
+ * @param offset New offset
+ * @see MPU6050_RA_YA_OFFS_H
+ */
+void MPU6050_setYAccelOffset(int16_t offset);
+
+/** Get Z-axis accelerometer offset.
+ * @return Current offset, added by the MPU6050 to the Z-axis accelerometer output
+ * @see MPU6050_RA_ZA_OFFS_H
+ */
+int16_t MPU6050_getZAccelOffset();
+
+/** Set Z-axis accelerometer offset.
+ * @param offset New offset
+ * @see MPU6050_RA_ZA_OFFS_H
+ */
+void MPU6050_setZAccelOffset(int16_t offset);
+
+/** Get X-axis gyroscope offset.
+ * @return Current offset, added by the MPU6050 to the X-axis gyroscope output
+ * @see MPU6050_RA_XG_OFFS_USRH
+ */
+int16_t MPU6050_getXGyroOffset();
+
+/** Set X-axis gyroscope offset.
+ * @param offset New offset
+ * @see MPU6050_RA_XG_OFFS_USRH
+ */
+void MPU6050_setXGyroOffset(int16_t offset);
+
+/** Get Y-axis gyroscope offset.
+ * @return Current offset, added by the MPU6050 to the Y-axis gyroscope output
+ * @see MPU6050_RA_YG_OFFS_USRH
+ */
+int16_t MPU6050_getYGyroOffset();
+
+/** Set Y-axis gyroscope offset.
+ * @param offset New offset
+ * @see MPU6050_RA_YG_OFFS_USRH
+ */
+void MPU6050_setYGyroOffset(int16_t offset);
+
+/** Get Z-axis gyroscope offset.
+ * @return Current offset, added by the MPU6050 to the Z-axis gyroscope output
+ * @see MPU6050_RA_ZG_OFFS_USRH
+ */
+int16_t MPU6050_getZGyroOffset();
+
+/** Set Z-axis gyroscope offset.
+ * @param offset New offset
+ * @see MPU6050_RA_ZG_OFFS_USRH
+ */
+void MPU6050_setZGyroOffset(int16_t offset);
+
+/** Get all offset registers.
+ * @param offsets Container for the offsets
+ */
+void MPU6050_getOffsets(mpu6050_offsets_t *offsets);
+
+/** Set all offset registers.
+ * @param offsets New offsets
+ */
+void MPU6050_setOffsets(const mpu6050_offsets_t *offsets);
+
+// FIFO acquisition
+
+/** Start FIFO acquisition of accelerometer and gyroscope.
+ * Sets the DLPF and the sample rate, and enables the FIFO for the 6 axes.
+ * Samples are then moved from the FIFO to a ring buffer by MPU6050_fifoPoll(),
+ * which must be called before the FIFO fills up (85 samples, 85 ms at 1 kHz).
+ * @param rate_hz Sample rate (up to 1000 Hz, or 8000 Hz with DLPF disabled)
+ * @param dlpf_mode DLPF configuration (MPU6050_DLPF_BW_*)
+ * @return Actual sample rate in Hz
+ */
+uint16_t MPU6050_fifoStart(uint16_t rate_hz, uint8_t dlpf_mode);
+
+/** Stop FIFO acquisition.
+ */
+void MPU6050_fifoStop();
+
+/** Move the samples available in the FIFO to the ring buffer.
+ * Whole records are read, up to MPU6050_FIFO_BATCH per burst. On a FIFO
+ * overflow the FIFO is reset (its data is lost) and acquisition goes on.
+ * @return Number of samples added to the ring buffer
+ */
+uint16_t MPU6050_fifoPoll();
+
+/** Get the oldest sample of the ring buffer.
+ * Can be called from a different task than MPU6050_fifoPoll().
+ * @param sample Container for the sample
+ * @return true if there was a sample
+ */
+bool MPU6050_fifoGetSample(mpu6050_sample_t *sample);
+
+/** Number of samples in the ring buffer.
+ */
+uint16_t MPU6050_fifoAvailable();
+
+/** Start interrupt driven FIFO acquisition.
+ * Starts FIFO acquisition (see MPU6050_fifoStart) and enables the data ready
+ * interrupt on the INT pin (active high, 50 us pulse). An acquisition task wakes
+ * every batch samples, moves them to the ring buffer and calls func_p, so no
+ * polling timer is needed.
+ * @param int_pin GPIO connected to the INT pin of the MPU6050
+ * @param rate_hz Sample rate (see MPU6050_fifoStart)
+ * @param dlpf_mode DLPF configuration (MPU6050_DLPF_BW_*)
+ * @param batch Samples per wakeup (1 for the lowest latency, up to MPU6050_FIFO_BATCH)
+ * @param func_p Function called from the acquisition task after the samples are published, NULL for none
+ * @param param_p Parameter of func_p
+ * @param priority Priority of the acquisition task
+ * @return Actual sample rate in Hz, 0 if the task couldn't be created
+ */
+uint16_t MPU6050_intStart(gpio_t int_pin, uint16_t rate_hz, uint8_t dlpf_mode, uint8_t batch, void *func_p, void *param_p, uint8_t priority);
+
+/** Stop interrupt driven acquisition.
+ */
+void MPU6050_intStop();
+
+/** Get FIFO acquisition statistics.
+ * @param stats Container for the statistics
+ */
+void MPU6050_fifoGetStats(mpu6050_fifo_stats_t *stats);
+
+// DMP offload
+
+/** Load a DMP firmware image and start the DMP.
+ * The image is not part of the driver: the application supplies it (for
+ * instance the MotionApps 6.12 image distributed by InvenSense, which needs no
+ * further configuration writes). The DMP then writes a packet_size packet to
+ * the FIFO per output sample, with the fused orientation, and the host only
+ * reads packets (MPU6050_dmpGetPacket) instead of every raw sample.
+ * Sets the gyroscope to +-2000 dps, the accelerometer to +-2 g and the DLPF
+ * to 188 Hz, as expected by the MotionApps images. FIFO acquisition
+ * (MPU6050_fifoStart, MPU6050_intStart) must be stopped first.
+ * @param firmware DMP program, loaded from bank 0 address 0
+ * @param size Bytes of the program (up to MPU6050_DMP_MEMORY_BANKS * MPU6050_DMP_MEMORY_BANK_SIZE)
+ * @param start_address Program start address (MPU6050_DMP_START_ADDRESS)
+ * @param packet_size FIFO packet size of the image (MPU6050_DMP_PACKET_612 or MPU6050_DMP_PACKET_20)
+ * @param rate_div DMP sample rate = 1 kHz / (1 + rate_div). The image may output a fraction of it
+ * @return true if the image was loaded and verified
+ */
+bool MPU6050_dmpStart(const uint8_t *firmware, uint16_t size, uint16_t start_address, uint8_t packet_size, uint8_t rate_div);
+
+/** Stop the DMP and disable the FIFO.
+ */
+void MPU6050_dmpStop();
+
+/** Read the oldest DMP packet of the FIFO.
+ * A FIFO that overflowed or is not aligned to whole packets is reset, and the
+ * packets it held are lost (counted in the overflows statistic).
+ * @param packet Container for the packet data
+ * @return true if a valid packet was read
+ */
+bool MPU6050_dmpGetPacket(mpu6050_dmp_packet_t *packet);
+
+// Calibration
+
+/** Calibrate the accelerometer and gyroscope offsets.
+ * The device must be still, with the Z axis pointing up. Each round averages
+ * samples samples read from the FIFO in bursts (1 kHz, DLPF 42 Hz) and
+ * corrects the offset registers so that the mean output is 0 on every axis,
+ * except +1 g on accelerometer Z. Takes about MPU6050_CALIB_ROUNDS * samples ms.
+ * Refused while an acquisition (FIFO, interrupt driven or DMP) is running.
+ * The DLPF and sample rate in use are restored at the end.
+ * @param samples Samples per round (MPU6050_CALIB_SAMPLES)
+ * @param offsets Container for the resulting offsets, NULL if not needed
+ * @return true if every round got its samples, false if a round didn't or
+ * an acquisition is running
+ */
+bool MPU6050_calibrate(uint16_t samples, mpu6050_offsets_t *offsets);
+
+/** Store offsets in NVS.
+ * @param offsets Offsets to store (MPU6050_getOffsets)
+ * @return true on success
+ */
+bool MPU6050_saveOffsets(const mpu6050_offsets_t *offsets);
+
+/** Load the offsets stored in NVS and write them to the offset registers.
+ * Avoids a calibration at each boot.
+ * @param offsets Container for the offsets loaded, NULL if not needed
+ * @return true if there were offsets stored
+ */
+bool MPU6050_loadOffsets(mpu6050_offsets_t *offsets);
+
 /** @} doxygen end group definition */
 /** @} doxygen end group definition */
 /** @} doxygen end group definition */
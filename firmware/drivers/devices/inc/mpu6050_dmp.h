@@ -0,0 +1,75 @@
+#ifndef MPU6050_DMP_H
+#define MPU6050_DMP_H
+
+/** \addtogroup Drivers_Programable Drivers Programable
+ ** @{ */
+/** \addtogroup Drivers_Devices Drivers devices
+ ** @{ */
+/** \addtogroup MPU6050 MPU6050
+ ** @{ */
+
+/** \brief Packets written to the FIFO by the MPU6050 Digital Motion Processor.
+ *
+ * The DMP runs a firmware image loaded by MPU6050_dmpStart and writes to the
+ * FIFO a fixed size packet per output sample, with the fused orientation as a
+ * Q30 quaternion. The layout depends on the image:
+ *
+ * | Image            | Size | Quaternion | Gyro                     | Accel                    |
+ * |:----------------:|:----:|:----------:|:------------------------:|:------------------------:|
+ * | MotionApps 6.12  | 28   | 0-15       | 22-27 (int16)            | 16-21 (int16)            |
+ * | MotionApps 2.0   | 42   | 0-15       | 16-27 (int32, high half) | 28-39 (int32, high half) |
+ *
+ * Parsing has no dependencies on the rest of the driver, so it is checked on
+ * the host with firmware/tools/mpu6050_dmp_check.c.
+ *
+ * @author Joaquin Palacio
+ *
+ * @section changelog
+ *
+ * |   Date	    | Description                                    						|
+ * |:----------:|:----------------------------------------------------------------------|
+ * | 19/10/2026 | Document creation		                         						|
+ *
+ **/
+
+/*==================[inclusions]=============================================*/
+#include <stdint.h>
+#include <stdbool.h>
+/*==================[macros]=================================================*/
+#define MPU6050_DMP_PACKET_612		28		/*!< Packet size of the MotionApps 6.12 image */
+#define MPU6050_DMP_PACKET_20		42		/*!< Packet size of the MotionApps 2.0 image */
+#define MPU6050_DMP_PACKET_MAX		42		/*!< Largest packet supported */
+#define MPU6050_DMP_START_ADDRESS	0x0400	/*!< Program start address of the MotionApps images */
+
+/*==================[typedef]================================================*/
+/**
+ * @brief Data of a DMP packet
+ */
+typedef struct {
+	int32_t q[4];				/*!< Orientation quaternion w, x, y, z (Q30), same format as imu_fusion_t */
+	int16_t accel[3];			/*!< Accelerometer X, Y, Z (raw counts) */
+	int16_t gyro[3];			/*!< Gyroscope X, Y, Z (raw counts) */
+} mpu6050_dmp_packet_t;
+
+/*==================[external data declaration]==============================*/
+
+/*==================[external functions declaration]=========================*/
+/**
+ * @brief Decodes a DMP packet
+ *
+ * A packet whose quaternion is far from unit length is rejected: it is what
+ * is read when the FIFO is no longer aligned to the packet boundaries.
+ *
+ * @param data packet as read from the FIFO
+ * @param size packet size (MPU6050_DMP_PACKET_612 or MPU6050_DMP_PACKET_20)
+ * @param packet container for the decoded data
+ * @return true if the packet is valid
+ */
+bool MPU6050_dmpParsePacket(const uint8_t *data, uint8_t size, mpu6050_dmp_packet_t *packet);
+
+/*==================[end of file]============================================*/
+#endif /* #ifndef MPU6050_DMP_H */
+
+/** @} doxygen end group definition */
+/** @} doxygen end group definition */
+/** @} doxygen end group definition */
@@ -0,0 +1,127 @@
+#ifndef SPRITE_LAYER_H
+#define SPRITE_LAYER_H
+
+/** \addtogroup Drivers_Programable Drivers Programable
+ ** @{ */
+/** \addtogroup Drivers_Devices Drivers devices
+ ** @{ */
+/** \addtogroup Sprite_Layer Sprite Layer
+ ** @{ */
+
+/** \brief Sprite compositing for the ILI9341 LCD.
+ *
+ * A layer is a rectangular area of the LCD with a background color and a set
+ * of sprites (pictures with a position, raw or RLE compressed, optionally with
+ * a transparent color). Showing, hiding, moving or changing the picture of a
+ * sprite only marks the affected area as dirty. SpriteLayerRender() then
+ * composes the dirty area (background and every visible sprite, in the order
+ * they were added) and sends it to the LCD in a single window, so a blink or
+ * an animation frame costs one blit, with no separate erase.
+ *
+ * @author Joaquin Palacio
+ *
+ * @section changelog
+ *
+ * |   Date	    | Description                                    						|
+ * |:----------:|:----------------------------------------------------------------------|
+ * | 19/10/2026 | Document creation		                         						|
+ *
+ **/
+
+/*==================[inclusions]=============================================*/
+#include <stdbool.h>
+#include <stdint.h>
+/*==================[macros]=================================================*/
+#define SPRITE_LAYER_MAX	8		/*!< Maximum number of sprites in a layer */
+
+/*==================[typedef]================================================*/
+typedef struct sprite_layer_s sprite_layer_t;
+
+/**
+ * @brief Sprite
+ */
+typedef struct {
+	uint16_t x;					/*!< X position of top left corner (LCD coordinates) */
+	uint16_t y;					/*!< Y position of top left corner (LCD coordinates) */
+	uint16_t width;				/*!< Picture width in pixels */
+	uint16_t height;			/*!< Picture height in pixels */
+	const uint8_t *pic;			/*!< Picture, 2 bytes per pixel (high byte first) */
+	bool rle;					/*!< true if pic is RLE compressed (see ili9341_rle_t) */
+	bool transparent;			/*!< true if pixels of color key are not drawn */
+	uint16_t key;				/*!< Transparent color */
+	bool visible;				/*!< Sprite is drawn */
+	sprite_layer_t *layer;		/*!< Layer the sprite belongs to (set by SpriteLayerAdd) */
+} sprite_t;
+
+/**
+ * @brief Layer of sprites
+ */
+struct sprite_layer_s {
+	uint16_t x;									/*!< X position of top left corner of the layer */
+	uint16_t y;									/*!< Y position of top left corner of the layer */
+	uint16_t width;								/*!< Layer width */
+	uint16_t height;							/*!< Layer height */
+	uint16_t background;						/*!< Background color */
+	sprite_t *sprites[SPRITE_LAYER_MAX];		/*!< Sprites, from bottom to top */
+	uint8_t n_sprites;							/*!< Number of sprites */
+	bool dirty;									/*!< There is an area to render */
+	uint16_t x0, y0, x1, y1;					/*!< Dirty area (LCD coordinates, inclusive) */
+};
+
+/*==================[external data declaration]==============================*/
+
+/*==================[external functions declaration]=========================*/
+/**
+ * @brief Initializes a layer and draws its background
+ *
+ * @param layer layer to initialize, with position, size and background set
+ */
+void SpriteLayerInit(sprite_layer_t *layer);
+
+/**
+ * @brief Adds a sprite on top of the ones already in the layer
+ *
+ * @param layer layer
+ * @param sprite sprite, with position, size, picture and visibility set
+ * @return true if added, false if the layer is full
+ */
+bool SpriteLayerAdd(sprite_layer_t *layer, sprite_t *sprite);
+
+/**
+ * @brief Shows or hides a sprite
+ *
+ * @param sprite sprite
+ * @param visible true to show the sprite
+ */
+void SpriteSetVisible(sprite_t *sprite, bool visible);
+
+/**
+ * @brief Moves a sprite
+ *
+ * @param sprite sprite
+ * @param x new X position of top left corner
+ * @param y new Y position of top left corner
+ */
+void SpriteMove(sprite_t *sprite, uint16_t x, uint16_t y);
+
+/**
+ * @brief Changes the picture of a sprite (animation frame), same size and format
+ *
+ * @param sprite sprite
+ * @param pic new picture
+ */
+void SpriteSetPicture(sprite_t *sprite, const uint8_t *pic);
+
+/**
+ * @brief Composes the dirty area of a layer and sends it to the LCD
+ *
+ * @param layer layer
+ */
+void SpriteLayerRender(sprite_layer_t *layer);
+
+/*==================[end of file]============================================*/
+#endif /* #ifndef SPRITE_LAYER_H */
+
+/** @} doxygen end group definition */
+/** @} doxygen end group definition */
+/** @} doxygen end group definition */
@@ -12,81 +12,406 @@
 /*==================[inclusions]=============================================*/
 #include "hc_sr04.h"
 #include "delay_mcu.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 /*==================[macros and definitions]=================================*/
 #define MAX_US		17700	/* maximun distance time in us (300cm or 118inch) */
 #define MAX_CM		300		/* maximun distance time in cm */
 #define MAX_INCH	118		/* maximun distance time in inch */
 #define US2CM		59		/* scale factor to conver pulse width to cm */
 #define US2INCH		150		/* scale factor to conver pulse width to inch */
-#define WAIT_MAX	5900	/* maximun time to wait for echo signal */
+#define TRIGGER_US	10		/* trigger pulse width */
+
+typedef enum {
+	ECHO_IDLE,				/* no measurement in progress */
+	ECHO_TRIGGERED,			/* waiting for the echo rising edge */
+	ECHO_HIGH				/* waiting for the echo falling edge */
+} echo_state_t;
+
+typedef struct {
+	gpio_t echo;					/* echo pin */
+	gpio_t trigger;					/* trigger pin */
+	uint8_t slot;					/* scheduler slot */
+	volatile echo_state_t state;	/* measurement in progress */
+	int64_t t_trigger;				/* time of the trigger pulse */
+	int64_t t_rise;					/* time of the echo rising edge */
+	volatile uint32_t echo_us;		/* echo width of the last measurement, 0 if none */
+} sensor_t;
 /*==================[internal data declaration]==============================*/
-static gpio_t echo_st, trigger_st; /**<  Stores the pin inicilization*/
+static sensor_t sensors[HC_SR04_MAX_SENSORS];	/**< The single sensor functions use the first one */
+static uint8_t n_sensors;					/**< Sensors with the echo interrupt enabled */
+static portMUX_TYPE echo_mux = portMUX_INITIALIZER_UNLOCKED;	/**< Echo state, shared with the interrupt */
+static void (*done_func_p)(void*);			/**< Called when a measurement ends */
+static void *done_param_p;					/**< Parameter of done_func_p */
+static SemaphoreHandle_t done;				/**< Given when a measurement ends, for the blocking reads */
+static StaticSemaphore_t done_buffer;
+
+static esp_timer_handle_t slot_timer;		/**< Scheduler time base */
+static bool scheduler_on;					/**< The sensors belong to the scheduler */
+static uint8_t n_slots;						/**< Slots of the scheduler */
+static uint8_t slot;						/**< Slot running */
+static uint32_t slot_period;				/**< Slot length in us */
+static uint32_t published_us[HC_SR04_MAX_SENSORS];	/**< Echo widths of the last publication */
+static uint32_t publications;				/**< Publications since the start */
+static void (*publish_func_p)(void*);		/**< Called on every publication */
+static void *publish_param_p;				/**< Parameter of publish_func_p */
 /*==================[internal functions declaration]=========================*/
+/**
+ * @brief Echo pin interrupt, on both edges
+ */
+static void HcSr04EchoIsr(void *param);
+
+/**
+ * @brief Converts an echo width to distance
+ * 
+ * @param width echo width in us
+ * @param scale us per distance unit
+ * @param max maximum distance, returned when the width is out of range
+ * @return uint16_t distance
+ */
+static uint16_t HcSr04Convert(uint32_t width, uint16_t scale, uint16_t max);
+
+/**
+ * @brief Ends a measurement whose echo didn't end in time, echo_mux taken
+ * 
+ * @param sensor sensor to stop waiting for
+ */
+static void HcSr04Abandon(sensor_t *sensor);
+
+/**
+ * @brief Ends the measurements of the slot that was running
+ */
+static void HcSr04SchedulerClose(void);
+
+/**
+ * @brief Triggers all the sensors of the slot at once
+ */
+static void HcSr04SchedulerFire(void);
+
+/**
+ * @brief Scheduler time base, called every slot from the esp_timer task
+ */
+static void HcSr04SchedulerSlot(void *param);
+
+/**
+ * @brief Triggers a measurement and waits for it to end
+ * 
+ * @return uint32_t echo width in us, 0 if the echo never started, above
+ * MAX_US if it didn't end in time
+ */
+static uint32_t HcSr04Measure(void);
 
 /*==================[internal data definition]===============================*/
 
 /*==================[external data definition]===============================*/
 
 /*==================[internal functions definition]==========================*/
+static void HcSr04EchoIsr(void *param){
+	sensor_t *sensor = param;
+	int64_t now = esp_timer_get_time();
+	BaseType_t woken = pdFALSE;
+	bool ended = false;
+
+	/* Both edges take the same path, so the interrupt latency cancels out */
+	portENTER_CRITICAL_SAFE(&echo_mux);
+	if(GPIORead(sensor->echo)){
+		if(sensor->state == ECHO_TRIGGERED){
+			sensor->t_rise = now;
+			sensor->state = ECHO_HIGH;
+		}
+	} else if(sensor->state == ECHO_HIGH){
+		sensor->echo_us = now - sensor->t_rise;
+		sensor->state = ECHO_IDLE;
+		ended = true;
+	}
+	portEXIT_CRITICAL_SAFE(&echo_mux);
+
+	/* The scheduler collects the results at the end of the slot */
+	if(ended && !scheduler_on){
+		if(done_func_p != NULL){
+			done_func_p(done_param_p);
+		}
+		xSemaphoreGiveFromISR(done, &woken);
+		portYIELD_FROM_ISR(woken);
+	}
+}
+
+static uint16_t HcSr04Convert(uint32_t width, uint16_t scale, uint16_t max){
+	if(width > MAX_US){
+		return max;
+	}
+	return width / scale;
+}
+
+static void HcSr04Abandon(sensor_t *sensor){
+	if(sensor->state == ECHO_TRIGGERED){
+		/* The echo never started: sensor disconnected */
+		sensor->echo_us = 0;
+	} else if(sensor->state == ECHO_HIGH){
+		/* Still waiting for the echo: nothing in range */
+		sensor->echo_us = MAX_US + 1;
+	}
+	sensor->state = ECHO_IDLE;
+}
+
+static void HcSr04SchedulerClose(void){
+	uint8_t i;
+
+	portENTER_CRITICAL_SAFE(&echo_mux);
+	for(i = 0; i < n_sensors; i++){
+		if(sensors[i].slot == slot){
+			HcSr04Abandon(&sensors[i]);
+		}
+	}
+	portEXIT_CRITICAL_SAFE(&echo_mux);
+}
+
+static void HcSr04SchedulerFire(void){
+	int64_t now = esp_timer_get_time();
+	uint8_t i;
+
+	for(i = 0; i < n_sensors; i++){
+		if(sensors[i].slot != slot){
+			continue;
+		}
+		if(GPIORead(sensors[i].echo)){
+			/* Echo pulse of the last ping still on (no obstacle), the module
+			 * would ignore the trigger */
+			sensors[i].echo_us = MAX_US + 1;
+			continue;
+		}
+		sensors[i].t_trigger = now;
+		sensors[i].state = ECHO_TRIGGERED;
+		GPIOOn(sensors[i].trigger);
+	}
+	DelayUs(TRIGGER_US);
+	for(i = 0; i < n_sensors; i++){
+		if(sensors[i].slot == slot){
+			GPIOOff(sensors[i].trigger);
+		}
+	}
+}
+
+static void HcSr04SchedulerSlot(void *param){
+	uint8_t i;
+
+	HcSr04SchedulerClose();
+	if(++slot >= n_slots){
+		slot = 0;
+		portENTER_CRITICAL_SAFE(&echo_mux);
+		for(i = 0; i < n_sensors; i++){
+			published_us[i] = sensors[i].echo_us;
+		}
+		publications++;
+		portEXIT_CRITICAL_SAFE(&echo_mux);
+		if(publish_func_p != NULL){
+			publish_func_p(publish_param_p);
+		}
+	}
+	HcSr04SchedulerFire();
+}
+
+static uint32_t HcSr04Measure(void){
+	/* A semaphore and not a task notification: the caller may be using
+	 * its notifications for something else */
+	xSemaphoreTake(done, 0);
+	if(!HcSr04Trigger(NULL, NULL)){
+		return 0;
+	}
+	if(xSemaphoreTake(done, HC_SR04_ECHO_TIMEOUT_US / 1000 / portTICK_PERIOD_MS + 1) != pdTRUE){
+		portENTER_CRITICAL_SAFE(&echo_mux);
+		HcSr04Abandon(&sensors[0]);
+		portEXIT_CRITICAL_SAFE(&echo_mux);
+	}
+	return sensors[0].echo_us;
+}
 
 /*==================[external functions definition]==========================*/
 
 bool HcSr04Init(gpio_t echo, gpio_t trigger){
-	echo_st = echo;
-	trigger_st = trigger;
+	sensor_t *sensor = &sensors[0];
 
 	/** Configuration of the GPIO pins*/
 	GPIOInit(echo, GPIO_INPUT);
 	GPIOInit(trigger, GPIO_OUTPUT);
 
+	if(done == NULL){
+		done = xSemaphoreCreateBinaryStatic(&done_buffer);
+	}
+	sensor->echo = echo;
+	sensor->trigger = trigger;
+	sensor->slot = 0;
+	sensor->state = ECHO_IDLE;
+	sensor->echo_us = 0;
+	n_sensors = 1;
+	GPIOActivIntBothEdges(echo, HcSr04EchoIsr, sensor);
+
 	return true;
 }
 
-uint16_t HcSr04ReadDistanceInCentimeters(void){
-	uint16_t distance = 0, waiting = 0;
-	GPIOOn(trigger_st);
-	DelayUs(10);
-	GPIOOff(trigger_st);
-	while(!GPIORead(echo_st)){
-		DelayUs(1);
-		waiting++;
-		if(waiting > WAIT_MAX){
-			return 0;
+bool HcSr04Trigger(void *func_p, void *param_p){
+	sensor_t *sensor = &sensors[0];
+	int64_t now = esp_timer_get_time();
+
+	/* A measurement whose echo never came is abandoned after the timeout */
+	portENTER_CRITICAL_SAFE(&echo_mux);
+	if(sensor->state != ECHO_IDLE){
+		if(now - sensor->t_trigger < HC_SR04_ECHO_TIMEOUT_US){
+			portEXIT_CRITICAL_SAFE(&echo_mux);
+			return false;
 		}
+		HcSr04Abandon(sensor);
 	}
-	do{
-		DelayUs(1);
-		distance++;
-		if(distance > MAX_US)
-			return MAX_CM;
-	}
-	while(GPIORead(echo_st));
-	return (distance/US2CM);
+	done_func_p = func_p;
+	done_param_p = param_p;
+	sensor->t_trigger = now;
+	sensor->state = ECHO_TRIGGERED;
+	portEXIT_CRITICAL_SAFE(&echo_mux);
+	GPIOOn(sensor->trigger);
+	DelayUs(TRIGGER_US);
+	GPIOOff(sensor->trigger);
+	return true;
+}
+
+uint32_t HcSr04GetEchoUs(void){
+	return sensors[0].echo_us;
+}
+
+uint16_t HcSr04GetDistanceInCentimeters(void){
+	return HcSr04Convert(sensors[0].echo_us, US2CM, MAX_CM);
+}
+
+uint16_t HcSr04GetDistanceInInches(void){
+	return HcSr04Convert(sensors[0].echo_us, US2INCH, MAX_INCH);
+}
+
+uint16_t HcSr04ReadDistanceInCentimeters(void){
+	HcSr04Measure();
+	return HcSr04GetDistanceInCentimeters();
 }
 
 uint16_t HcSr04ReadDistanceInInches(void){
-	uint16_t distance = 0, waiting = 0;
-	GPIOOn(trigger_st);
-	DelayUs(10);
-	GPIOOff(trigger_st);
-	while(!GPIORead(echo_st)){
-		DelayUs(1);
-		waiting++;
-		if(waiting > WAIT_MAX){
-			return 0;
+	HcSr04Measure();
+	return HcSr04GetDistanceInInches();
+}
+
+bool HcSr04SchedulerStart(const hc_sr04_scheduler_t *config){
+	const esp_timer_create_args_t timer_args = {
+		.callback = HcSr04SchedulerSlot,
+		.name = "hc_sr04"
+	};
+	uint8_t i;
+
+	if((config->n_sensors == 0) || (config->n_sensors > HC_SR04_MAX_SENSORS) ||
+			(config->slot_us < HC_SR04_SLOT_MIN_US)){
+		return false;
+	}
+	n_slots = 0;
+	for(i = 0; i < config->n_sensors; i++){
+		/* No more slots than sensors */
+		if(config->sensors[i].slot >= config->n_sensors){
+			return false;
 		}
+		if(config->sensors[i].slot >= n_slots){
+			n_slots = config->sensors[i].slot + 1;
+		}
+	}
+	if(slot_timer == NULL){
+		if(esp_timer_create(&timer_args, &slot_timer) != ESP_OK){
+			return false;
+		}
+	}
+	HcSr04SchedulerStop();
+	/* Single sensor initialized with HcSr04Init */
+	for(i = 0; i < n_sensors; i++){
+		GPIODeactivInt(sensors[i].echo);
+	}
+
+	n_sensors = config->n_sensors;
+	for(i = 0; i < n_sensors; i++){
+		sensors[i].echo = config->sensors[i].echo;
+		sensors[i].trigger = config->sensors[i].trigger;
+		sensors[i].slot = config->sensors[i].slot;
+		sensors[i].state = ECHO_IDLE;
+		sensors[i].echo_us = 0;
+		published_us[i] = 0;
+		GPIOInit(sensors[i].echo, GPIO_INPUT);
+		GPIOInit(sensors[i].trigger, GPIO_OUTPUT);
+		GPIOActivIntBothEdges(sensors[i].echo, HcSr04EchoIsr, &sensors[i]);
+	}
+	slot_period = config->slot_us;
+	publish_func_p = config->func_p;
+	publish_param_p = config->param_p;
+	publications = 0;
+	slot = 0;
+	scheduler_on = true;
+
+	HcSr04SchedulerFire();
+	esp_timer_start_periodic(slot_timer, slot_period);
+	return true;
+}
+
+void HcSr04SchedulerStop(void){
+	uint8_t i;
+
+	if(!scheduler_on){
+		return;
+	}
+	esp_timer_stop(slot_timer);
+	for(i = 0; i < n_sensors; i++){
+		GPIODeactivInt(sensors[i].echo);
 	}
-	do{
-		DelayUs(1);
-		distance++;
-		if(distance > MAX_US)
-			return MAX_INCH;
+	n_sensors = 0;
+	scheduler_on = false;
+}
+
+uint32_t HcSr04SchedulerGetPeriod(void){
+	return n_slots * slot_period;
+}
+
+uint32_t HcSr04SchedulerGetDistancesInCentimeters(uint16_t *distances){
+	uint32_t widths[HC_SR04_MAX_SENSORS];
+	uint32_t count;
+	uint8_t i;
+
+	portENTER_CRITICAL_SAFE(&echo_mux);
+	for(i = 0; i < n_sensors; i++){
+		widths[i] = published_us[i];
+	}
+	count = publications;
+	portEXIT_CRITICAL_SAFE(&echo_mux);
+	for(i = 0; i < n_sensors; i++){
+		distances[i] = HcSr04Convert(widths[i], US2CM, MAX_CM);
 	}
-	while(GPIORead(echo_st));
-	return (distance/US2INCH);
+	return count;
+}
+
+uint32_t HcSr04SchedulerGetDistancesInInches(uint16_t *distances){
+	uint32_t widths[HC_SR04_MAX_SENSORS];
+	uint32_t count;
+	uint8_t i;
+
+	portENTER_CRITICAL_SAFE(&echo_mux);
+	for(i = 0; i < n_sensors; i++){
+		widths[i] = published_us[i];
+	}
+	count = publications;
+	portEXIT_CRITICAL_SAFE(&echo_mux);
+	for(i = 0; i < n_sensors; i++){
+		distances[i] = HcSr04Convert(widths[i], US2INCH, MAX_INCH);
+	}
+	return count;
 }
 
 bool HcSr04Deinit(void){
+	uint8_t i;
+
+	HcSr04SchedulerStop();
+	for(i = 0; i < n_sensors; i++){
+		GPIODeactivInt(sensors[i].echo);
+	}
+	n_sensors = 0;
 	GPIODeinit();
 	return true;
 }
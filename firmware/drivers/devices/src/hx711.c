@@ -8,12 +8,19 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "hx711.h"
 
 #include <delay_mcu.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
 
 /*==================[macros and definitions]=================================*/
+#define HX711_BITS		24
+#define HX711_OFFSET_BINARY	0x800000	/* HX711_read result for a 0 reading, OFFSET uses this scale */
 
 /*==================[internal data declaration]==============================*/
 uint8_t GAIN;		             /*!<  Amplification factor */
@@ -24,24 +31,88 @@ float SCALE;	                 /*!<  Used to return weight in grams, kg, ounces,
 gpio_t internal_pd_sck;
 gpio_t internal_dout;
 
+static QueueHandle_t readings;				/*!< Readings of the interrupt driven mode */
+static portMUX_TYPE shift_mux = portMUX_INITIALIZER_UNLOCKED;	/*!< Keeps the clock pulses short */
+
 /*==================[internal functions declaration]=========================*/
+/**
+ * @brief Clocks out a conversion and the GAIN pulses that select the next one
+ * @return Signed 24 bit result
+ */
+static int32_t HX711_shift(void);
 
-uint8_t shiftIn(void)
-{
-    uint8_t value = 0;
+/**
+ * @brief DOUT falling edge: reads the conversion and sends it to the queue
+ */
+static void HX711_isr(void *param);
 
-    for (uint8_t i = 0; i < 8; ++i)
-    {
-    	GPIOOn(internal_pd_sck);//PD_SCK_SET_HIGH;
-        value |= GPIORead(internal_dout) << (7 - i);
-        GPIOOff(internal_pd_sck);//PD_SCK_SET_LOW;
-    }
-    return value;
-}
+/**
+ * @brief Median of the filter window
+ */
+static int32_t HX711_median(const hx711_filter_t *filter);
 
 /*==================[external data definition]===============================*/
 
 /*==================[internal functions definition]==========================*/
+static int32_t HX711_shift(void)
+{
+	uint32_t count = 0;
+	uint8_t i;
+
+	/* PD_SCK high for more than 60 us powers the chip down: no interrupt
+	 * or task switch can stretch a pulse */
+	portENTER_CRITICAL_SAFE(&shift_mux);
+	for (i = 0; i < HX711_BITS + GAIN; i++)
+	{
+		GPIOOn(internal_pd_sck);
+		DelayUs(1);
+		GPIOOff(internal_pd_sck);
+		/* MSB first, each bit is valid after the rising edge */
+		if (i < HX711_BITS)
+		{
+			count = (count << 1) | GPIORead(internal_dout);
+		}
+	}
+	portEXIT_CRITICAL_SAFE(&shift_mux);
+	/* Sign extension of the 24 bit two's complement result */
+	return ((int32_t)(count << 8)) >> 8;
+}
+
+static void HX711_isr(void *param)
+{
+	hx711_reading_t reading;
+	BaseType_t woken = pdFALSE;
+
+	/* Data bits also make falling edges: only a low DOUT after the last
+	 * pulse (which sets it high) is a new conversion */
+	if (!HX711_isReady())
+	{
+		return;
+	}
+	reading.timestamp_us = esp_timer_get_time();
+	reading.value = HX711_shift();
+	xQueueSendFromISR(readings, &reading, &woken);
+	portYIELD_FROM_ISR(woken);
+}
+
+static int32_t HX711_median(const hx711_filter_t *filter)
+{
+	int32_t sorted[HX711_MEDIAN_SIZE];
+	int32_t v;
+	int8_t i, j;
+
+	/* Insertion sort, the window is tiny */
+	for (i = 0; i < HX711_MEDIAN_SIZE; i++)
+	{
+		v = filter->window[i];
+		for (j = i - 1; j >= 0 && sorted[j] > v; j--)
+		{
+			sorted[j + 1] = sorted[j];
+		}
+		sorted[j + 1] = v;
+	}
+	return sorted[HX711_MEDIAN_SIZE / 2];
+}
 
 /*==================[external functions definition]==========================*/
 void HX711_Init(uint8_t gain, gpio_t pd_sck, gpio_t dout)
@@ -80,38 +151,46 @@ void HX711_setGain(uint8_t gain)
 
 uint32_t HX711_read(void)
 {
-	// wait for the chip to become ready
-	while (!HX711_isReady());
-
-    unsigned long count;
-    unsigned char i;
-
-    GPIOOn(internal_dout);//DOUT_SET_HIGH;
+	// wait for the chip to become ready, without holding the CPU
+	while (!HX711_isReady())
+	{
+		vTaskDelay(1);
+	}
+	return (uint32_t)(HX711_shift() + HX711_OFFSET_BINARY);
+}
 
-    DelayUs(1);
+bool HX711_intStart(void)
+{
+	if (readings == NULL)
+	{
+		readings = xQueueCreate(HX711_QUEUE_LENGTH, sizeof(hx711_reading_t));
+		if (readings == NULL)
+		{
+			return false;
+		}
+	}
+	xQueueReset(readings);
+	GPIOActivInt(internal_dout, HX711_isr, false, NULL);
+	/* A conversion may already be waiting: its edge was missed */
+	if (HX711_isReady())
+	{
+		HX711_shift();
+	}
+	return true;
+}
 
-    GPIOOff(internal_pd_sck);//PD_SCK_SET_LOW;
-    DelayUs(1);
+void HX711_intStop(void)
+{
+	GPIODeactivInt(internal_dout);
+}
 
-    count=0;
-    while(GPIORead(internal_dout));
-    for(i=0;i<24;i++)
-    {
-    	 GPIOOn(internal_pd_sck);//PD_SCK_SET_HIGH;
-    	 DelayUs(1);
-        count=count<<1;
-        GPIOOff(internal_pd_sck);//PD_SCK_SET_LOW;
-        DelayUs(1);
-        if(GPIORead(internal_dout))
-            count++;
-    }
-    count = count>>6;
-    GPIOOn(internal_pd_sck);//PD_SCK_SET_HIGH;
-    DelayUs(1);
-    GPIOOff(internal_pd_sck);//PD_SCK_SET_LOW;
-    DelayUs(1);
-    count ^= 0x800000;
-    return(count);
+bool HX711_getReading(hx711_reading_t *reading, uint32_t timeout_ms)
+{
+	if (readings == NULL)
+	{
+		return false;
+	}
+	return xQueueReceive(readings, reading, timeout_ms / portTICK_PERIOD_MS) == pdTRUE;
 }
 
 uint32_t HX711_readAverage(uint8_t times)
@@ -132,7 +211,7 @@ double HX711_getValue(uint8_t times)
 
 float HX711_getUnits(uint8_t times)
 {
-	return HX711_get_value(times) / SCALE;
+	return HX711_getValue(times) / SCALE;
 }
 
 void HX711_tare(uint8_t times)
@@ -161,6 +240,98 @@ double HX711_getOffset(void)
 	return OFFSET;
 }
 
+void HX711_filterInit(hx711_filter_t *filter, uint8_t shift, int32_t step, int32_t band, uint8_t settle_readings)
+{
+	memset(filter, 0, sizeof(hx711_filter_t));
+	filter->shift = shift;
+	filter->step = step;
+	filter->band = band;
+	filter->settle_readings = settle_readings;
+	/* step_sign 0, no side yet: the first reading restarts the filter */
+}
+
+uint8_t HX711_filterUpdate(hx711_filter_t *filter, int32_t value)
+{
+	int32_t median, diff;
+	int8_t sign;
+	uint8_t i, events = 0;
+	bool restart = false;
+
+	/* Step detection on the raw reading, the median would delay it */
+	diff = value - (int32_t)(filter->smooth >> 8);
+	sign = (diff > 0) ? 1 : -1;
+	if (filter->step_sign == 0)
+	{
+		restart = true;
+	}
+	else if (diff > filter->step || -diff > filter->step)
+	{
+		if (sign != filter->step_sign)
+		{
+			filter->step_count = 0;
+		}
+		filter->step_sign = sign;
+		restart = (++filter->step_count >= HX711_STEP_CONFIRM);
+	}
+	else
+	{
+		filter->step_count = 0;
+	}
+	if (restart)
+	{
+		/* New load: start over from this reading */
+		for (i = 0; i < HX711_MEDIAN_SIZE; i++)
+		{
+			filter->window[i] = value;
+		}
+		filter->pos = 0;
+		filter->smooth = (int64_t)value << 8;
+		filter->step_count = 0;
+		filter->step_sign = sign;
+		filter->stable_count = 0;
+		filter->settled = false;
+		events |= HX711_EVENT_STEP;
+	}
+	else
+	{
+		filter->window[filter->pos] = value;
+		filter->pos = (filter->pos + 1) % HX711_MEDIAN_SIZE;
+	}
+
+	median = HX711_median(filter);
+	filter->smooth += (((int64_t)median << 8) - filter->smooth) >> filter->shift;
+
+	/* Settling: the median stays close to the smoothed value */
+	diff = median - (int32_t)(filter->smooth >> 8);
+	if (diff <= filter->band && -diff <= filter->band)
+	{
+		if (filter->stable_count < filter->settle_readings)
+		{
+			filter->stable_count++;
+		}
+		if (!filter->settled && filter->stable_count >= filter->settle_readings)
+		{
+			filter->settled = true;
+			events |= HX711_EVENT_SETTLED;
+		}
+	}
+	else
+	{
+		filter->stable_count = 0;
+	}
+	return events;
+}
+
+int32_t HX711_filterValue(const hx711_filter_t *filter)
+{
+	return (int32_t)(filter->smooth >> 8);
+}
+
+float HX711_filterUnits(const hx711_filter_t *filter)
+{
+	return ((double)HX711_filterValue(filter) + HX711_OFFSET_BINARY - OFFSET) / SCALE;
+}
+
 void HX711_powerDown(void)
 {
 	GPIOOff(internal_pd_sck);//PD_SCK_SET_LOW;
@@ -26,9 +26,12 @@
  * |   Date	    | Description                                    |
  * |:----------:|:-----------------------------------------------|
  * | 21/11/2018 | Document creation		                         |
+ * | 19/10/2026 | RLE compressed pictures                        |
  *
  */
 
+#include <stddef.h>
+#include <string.h>
 #include "ili9341.h"
 #include "fonts.h"
 #include "spi_mcu.h"
@@ -39,7 +42,6 @@
  * Private macros/types/enumerations/variables definitions
  ****************************************************************************/
 
-#define NULL 0
 
 #define SPI_BR 20000000				/*!< Frequency of sck for SPI communication */
 #define MAX_PIXEL 320*240*2			/*!< Maximum number of bytes to write on LCD */
@@ -54,6 +56,7 @@
 #define RESET				0x01 	/*!< Resets the commands and parameters to their S/W Reset default values */
 #define SLEEP_IN			0x10 	/*!< Enter to the minimum power consumption mode */
 #define SLEEP_OUT			0x11 	/*!< Turns off sleep mode */
+#define NORMAL_MODE_ON		0x13 	/*!< Returns the display to normal mode (leaves partial and scroll mode) */
 #define DISPLAY_INV_OFF		0x20 	/*!< Recover from display inversion mode */
 #define DISPLAY_INV_ON		0x21 	/*!< Invert every bit from the frame memory to the display */
 #define GAMMA_SET			0x26 	/*!< Select the desired Gamma curve for the current display */
@@ -62,7 +65,9 @@
 #define COLUMN_ADDR_SET		0x2A 	/*!< Define columns of frame memory where MCU can access */
 #define PAGE_ADDR_SET		0x2B 	/*!< Define rows of frame memory where MCU can access */
 #define MEM_WRITE			0x2C 	/*!< Transfer data from MCU to frame memory */
+#define VERT_SCROLL_DEF		0x33 	/*!< Defines the vertical scrolling area of the display */
 #define MEM_ACC_CTRL		0x36 	/*!< Defines read/write scanning direction of frame memory */
+#define VERT_SCROLL_START	0x37 	/*!< Frame memory line shown at the top of the scrolling area */
 #define PIXEL_FORMAT_SET	0x3A 	/*!< Sets the pixel format for the RGB image data used by the interface */
 #define WRITE_DISP_BRIGHT	0x51 	/*!< Adjust the brightness value of the display */
 #define WRITE_CTRL_DISP		0x53 	/*!< Control display brightness */
@@ -157,20 +162,21 @@ lcd_cmd_t lcd_init[] = {
 	{NEG_GAMMA, 15, neg_gamma},
 };
 
-lcd_cmd_t lcd_reset = {RESET, NULL, NULL};			/*!< SW reset */
-lcd_cmd_t lcd_sleep_out = {SLEEP_OUT, NULL, NULL};	/*!< Exit sleep mode */
-lcd_cmd_t lcd_on = {DISPLAY_ON, NULL, NULL};		/*!< Exit sleep mode */
+lcd_cmd_t lcd_reset = {RESET, 0, NULL};			/*!< SW reset */
+lcd_cmd_t lcd_sleep_out = {SLEEP_OUT, 0, NULL};	/*!< Exit sleep mode */
+lcd_cmd_t lcd_on = {DISPLAY_ON, 0, NULL};		/*!< Exit sleep mode */
 
 /*
  * @brief: SPI port configuration compatible with LCD interface
  */
 spi_mcu_config_t spi_conf = {
-	.device = NULL, 
+	.device = SPI_1, 
 	.clk_mode = MODE0, 
 	.bitrate = SPI_BR, 
-	.transfer_mode = SPI_POLLING, 
+	.transfer_mode = SPI_POLLING, 	/* Not used: every write is queued (see WriteLCD) */
 	.func_p = NULL,
-	.param_p = NULL };
+	.param_p = NULL,
+	.dc_control = true };
 
 static spi_dev_t ili9341_spi;							/*!< uC SPI port */
 static gpio_t ili9341_dc, ili9341_rst;		/*!< uC GPIO ports to use as CS, DC and RST */
@@ -216,22 +222,44 @@ void SetCursorPosition(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
  */
 void Fill(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t color);
 
+/**
+ * @brief  		Fill an area of LCD clipped to the screen limits
+ * @param[in]  	x0: Start column (can be negative or beyond the screen)
+ * @param[in]  	y0: Start row (can be negative or beyond the screen)
+ * @param[in]  	x1: End column
+ * @param[in]  	y1: End row
+ * @param[in]	color: color
+ * @retval 		None
+ */
+static void FillSpan(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color);
+
+/**
+ * @brief  		Draw the eight mirrored runs of a circle outline
+ * @param[in]  	x0, y0: Center of the circle
+ * @param[in]  	x_start: First x offset of the run
+ * @param[in]  	x_end: Last x offset of the run
+ * @param[in]  	y: y offset shared by all pixels of the run
+ * @param[in]	color: color
+ * @retval 		None
+ */
+static void CircleRuns(int16_t x0, int16_t y0, int16_t x_start, int16_t x_end, int16_t y, uint16_t color);
+
 /*****************************************************************************
  * Private functions declarations
  ****************************************************************************/
 void WriteLCD(lcd_cmd_t * data){
-	SpiInit(&spi_conf);
-	/* If command is NULL don't send command */
-	if (data->cmd != NULL){
+	/* D/C is set by the SPI driver when each transaction starts, so commands
+	 * and data are queued back to back without waiting */
+	/* If command is 0 don't send command */
+	if (data->cmd != 0){
 		/* Send command */
-		GPIOOff(ili9341_dc);
-		SpiWrite(ili9341_spi, &data->cmd, 1);
+		SpiQueueWriteDC(ili9341_spi, false, &data->cmd, 1, NULL, NULL);
 	}
 	/* If there are parameters or data to send */
-	if (data->databytes != NULL){
-		/* Send parameters or data */
-		GPIOOn(ili9341_dc);
-		SpiWrite(ili9341_spi, data->data, data->databytes);
+	if (data->databytes != 0){
+		/* Send parameters or data. Up to 4 bytes are copied, longer data
+		 * must stay unchanged until ILI9341Wait() */
+		SpiQueueWriteDC(ili9341_spi, true, data->data, data->databytes, NULL, NULL);
 	}
 }
 
@@ -276,23 +304,82 @@ void Fill(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t color){
 	/* Define area to fill */
 	SetCursorPosition(x0, y0, x1, y1);
 
-	for (i = 0; i < MAX_VALUE_SIZE; i += 2){
+	/* The buffer may still be in use by the previous transfer */
+	ILI9341Wait();
+	/* Only the part of the buffer that will be sent needs the color. The same
+	 * buffer is queued as many times as needed */
+	for (i = 0; (i < MAX_VALUE_SIZE) && (i < bytes_count); i += 2){
 		pixel[i] = HighByte(color);
 		pixel[i + 1] = LowByte(color);
 	}
 	/* Start writing LCD memory */
-	lcd_cmd_t lcd_write = {MEM_WRITE, NULL, NULL};
+	lcd_cmd_t lcd_write = {MEM_WRITE, 0, NULL};
 	WriteLCD(&lcd_write);
 
 	while(bytes_count - MAX_VALUE_SIZE > 0){
-		lcd_cmd_t lcd_pixel = {NULL, MAX_VALUE_SIZE, pixel};
+		lcd_cmd_t lcd_pixel = {0, MAX_VALUE_SIZE, pixel};
 		WriteLCD(&lcd_pixel);
 		bytes_count -= MAX_VALUE_SIZE;
 	}
-	lcd_cmd_t lcd_pixel = {NULL, bytes_count, pixel};
+	lcd_cmd_t lcd_pixel = {0, bytes_count, pixel};
 	WriteLCD(&lcd_pixel);
 }
 
+static void FillSpan(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color){
+	static int16_t aux;
+
+	if (x0 > x1){
+		aux = x0;
+		x0 = x1;
+		x1 = aux;
+	}
+	if (y0 > y1){
+		aux = y0;
+		y0 = y1;
+		y1 = aux;
+	}
+	/* Completely outside the screen */
+	if ((x1 < 0) || (y1 < 0) || (x0 >= lcd_orientation.width) || (y0 >= lcd_orientation.height)){
+		return;
+	}
+	/* Clip to screen limits */
+	if (x0 < 0){
+		x0 = 0;
+	}
+	if (y0 < 0){
+		y0 = 0;
+	}
+	if (x1 >= lcd_orientation.width){
+		x1 = lcd_orientation.width - 1;
+	}
+	if (y1 >= lcd_orientation.height){
+		y1 = lcd_orientation.height - 1;
+	}
+	Fill(x0, y0, x1, y1, color);
+}
+
+static void CircleRuns(int16_t x0, int16_t y0, int16_t x_start, int16_t x_end, int16_t y, uint16_t color){
+	if (x_start == 0){
+		/* Runs touching the axes join with their mirror */
+		FillSpan(x0 - x_end, y0 + y, x0 + x_end, y0 + y, color);
+		FillSpan(x0 - x_end, y0 - y, x0 + x_end, y0 - y, color);
+		FillSpan(x0 + y, y0 - x_end, x0 + y, y0 + x_end, color);
+		FillSpan(x0 - y, y0 - x_end, x0 - y, y0 + x_end, color);
+	}
+	else{
+		/* Horizontal runs, octants near the vertical axis */
+		FillSpan(x0 + x_start, y0 + y, x0 + x_end, y0 + y, color);
+		FillSpan(x0 - x_end, y0 + y, x0 - x_start, y0 + y, color);
+		FillSpan(x0 + x_start, y0 - y, x0 + x_end, y0 - y, color);
+		FillSpan(x0 - x_end, y0 - y, x0 - x_start, y0 - y, color);
+		/* Vertical runs, octants near the horizontal axis */
+		FillSpan(x0 + y, y0 + x_start, x0 + y, y0 + x_end, color);
+		FillSpan(x0 + y, y0 - x_end, x0 + y, y0 - x_start, color);
+		FillSpan(x0 - y, y0 + x_start, x0 - y, y0 + x_end, color);
+		FillSpan(x0 - y, y0 - x_end, x0 - y, y0 - x_start, color);
+	}
+}
+
 /*****************************************************************************
  * Public functions declarations
  ****************************************************************************/
@@ -300,12 +387,14 @@ void Fill(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t color){
 uint8_t ILI9341Init(spi_dev_t spi_dev, uint8_t gpio_dc, uint8_t gpio_rst){
 	/* SPI configuration */
 	spi_conf.device = spi_dev;
+	spi_conf.dc_gpio = gpio_dc;
 	ili9341_spi = spi_dev;
 	/* GPIOs configuration and initialization */
 	ili9341_dc = gpio_dc;
 	ili9341_rst = gpio_rst;
 	GPIOInit(ili9341_dc, GPIO_OUTPUT);
 	GPIOInit(ili9341_rst, GPIO_OUTPUT);
+	SpiInit(&spi_conf);
 
 	/* RST must be held low for minimum 10µsec after VCC have been applied */
 	DelayUs(10);
@@ -314,6 +403,7 @@ uint8_t ILI9341Init(spi_dev_t spi_dev, uint8_t gpio_dc, uint8_t gpio_rst){
 	DelayUs(10);
 	/* It will be necessary to wait 5msec before sending new command following software reset */
 	WriteLCD(&lcd_reset);
+	ILI9341Wait();
 	DelayMs(5);
 	/* Send initial configuration to LCD */
 	for (uint8_t i = 0; i < sizeof(lcd_init)/sizeof(lcd_cmd_t); i++){
@@ -321,8 +411,10 @@ uint8_t ILI9341Init(spi_dev_t spi_dev, uint8_t gpio_dc, uint8_t gpio_rst){
 	}
 	/* It will be necessary to wait 5msec before sending next command after sleep out */
 	WriteLCD(&lcd_sleep_out);
+	ILI9341Wait();
 	DelayMs(10);
 	WriteLCD(&lcd_on);
+	ILI9341Wait();
 	DelayMs(20);
 	/* Start screen on White */
 	ILI9341Fill(ILI9341_WHITE);
@@ -377,6 +469,26 @@ void ILI9341Rotate(ili9341_orientation_t orientation){
 	WriteLCD(&lcd_mem_acc);
 }
 
+void ILI9341SetScrollArea(uint16_t top_fixed, uint16_t scroll_height, uint16_t bottom_fixed){
+	uint8_t scroll_def[] = {HighByte(top_fixed), LowByte(top_fixed), HighByte(scroll_height),
+			LowByte(scroll_height), HighByte(bottom_fixed), LowByte(bottom_fixed)};
+	lcd_cmd_t lcd_scroll_def = {VERT_SCROLL_DEF, sizeof(scroll_def), scroll_def};
+	WriteLCD(&lcd_scroll_def);
+	/* scroll_def is too long to be copied by the SPI driver */
+	ILI9341Wait();
+}
+
+void ILI9341Scroll(uint16_t line){
+	uint8_t scroll_start[] = {HighByte(line), LowByte(line)};
+	lcd_cmd_t lcd_scroll_start = {VERT_SCROLL_START, sizeof(scroll_start), scroll_start};
+	WriteLCD(&lcd_scroll_start);
+}
+
+void ILI9341ScrollStop(void){
+	lcd_cmd_t lcd_normal = {NORMAL_MODE_ON, 0, NULL};
+	WriteLCD(&lcd_normal);
+}
+
 void ILI9341DrawChar(uint16_t x, uint16_t y, char data, Font_t* font, uint16_t foreground, uint16_t background){
 	static uint16_t i, j, k;
 	static uint16_t char_row;
@@ -400,9 +512,11 @@ void ILI9341DrawChar(uint16_t x, uint16_t y, char data, Font_t* font, uint16_t f
 	bytes_count = font->FontHeight * font->FontWidth * 2;
 
 	/* Start writing LCD memory */
-	lcd_cmd_t lcd_write = {MEM_WRITE, NULL, NULL};
+	lcd_cmd_t lcd_write = {MEM_WRITE, 0, NULL};
 	WriteLCD(&lcd_write);
 
+	/* The buffer may still be in use by the previous character */
+	ILI9341Wait();
 	/* Draw font data */
 	/* go through character rows */
 	k = 0;
@@ -413,8 +527,9 @@ void ILI9341DrawChar(uint16_t x, uint16_t y, char data, Font_t* font, uint16_t f
 		for (j = 0; j < font->FontWidth; j++)		{
 			/* If exceed buffer size, send buffer */
 			if ((2 * j + i * font->FontWidth * 2 - k * MAX_VALUE_SIZE + 1) > MAX_VALUE_SIZE)			{
-				lcd_cmd_t lcd_pixels = {NULL, MAX_VALUE_SIZE, pixel};
+				lcd_cmd_t lcd_pixels = {0, MAX_VALUE_SIZE, pixel};
 				WriteLCD(&lcd_pixels);
+				ILI9341Wait();
 				bytes_count -= MAX_VALUE_SIZE;
 				k++;
 			}
@@ -431,7 +546,7 @@ void ILI9341DrawChar(uint16_t x, uint16_t y, char data, Font_t* font, uint16_t f
 		}
 	}
 	/* Send the rest of the buffer */
-	lcd_cmd_t lcd_pixels = {NULL, bytes_count, pixel};
+	lcd_cmd_t lcd_pixels = {0, bytes_count, pixel};
 	WriteLCD(&lcd_pixels);
 }
 
@@ -496,8 +611,70 @@ void ILI9341GetStringSize(char* str, Font_t* font, uint16_t* width, uint16_t* he
 	*width = w;
 }
 
+void ILI9341TextInit(ili9341_text_t *widget, uint16_t x, uint16_t y, Font_t *font, uint16_t foreground, uint16_t background){
+	widget->x = x;
+	widget->y = y;
+	widget->font = font;
+	widget->foreground = foreground;
+	widget->background = background;
+	widget->text[0] = '\0';
+	widget->valid = false;
+}
+
+void ILI9341TextUpdate(ili9341_text_t *widget, const char *str){
+	uint8_t i = 0, old_len;
+	uint16_t lcd_x;
+
+	/* Draw only the character cells that changed */
+	while ((i < ILI9341_TEXT_MAX_LEN) && (str[i] != '\0')){
+		if (!widget->valid || (widget->text[i] != str[i])){
+			lcd_x = widget->x + i * widget->font->FontWidth;
+			ILI9341DrawChar(lcd_x, widget->y, str[i], widget->font, widget->foreground, widget->background);
+		}
+		/* Once the old text ends the rest of the new one is always drawn */
+		if (widget->text[i] == '\0'){
+			widget->text[i + 1] = '\0';
+		}
+		widget->text[i] = str[i];
+		i++;
+	}
+	/* If new text is shorter, erase the cells left over by the previous one */
+	old_len = i;
+	while ((old_len < ILI9341_TEXT_MAX_LEN) && (widget->text[old_len] != '\0')){
+		old_len++;
+	}
+	if (widget->valid && (old_len > i)){
+		Fill(widget->x + i * widget->font->FontWidth, widget->y,
+				widget->x + old_len * widget->font->FontWidth - 1, widget->y + widget->font->FontHeight - 1,
+				widget->background);
+	}
+	widget->text[i] = '\0';
+	widget->valid = true;
+}
+
+void ILI9341TextUpdateInt(ili9341_text_t *widget, uint32_t num, uint8_t dig){
+	char str[ILI9341_TEXT_MAX_LEN + 1];
+	uint8_t i;
+
+	if (dig > ILI9341_TEXT_MAX_LEN){
+		dig = ILI9341_TEXT_MAX_LEN;
+	}
+	for (i = 0; i < dig; i++){
+		str[dig - 1 - i] = num%10 + '0';
+		num = num/10;
+	}
+	str[dig] = '\0';
+	ILI9341TextUpdate(widget, str);
+}
+
+void ILI9341TextInvalidate(ili9341_text_t *widget){
+	widget->valid = false;
+}
+
 void ILI9341DrawLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t color){
 	static int16_t x_dist, y_dist, x_grow, y_grow, error, error_2;
+	static int16_t run_x, run_y, prev_x, prev_y;
+	static bool x_major;
 
 	/* Check for overflow */
 	if (x0 >= lcd_orientation.width){
@@ -537,20 +714,26 @@ void ILI9341DrawLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_
 	}
 	/* Diagonal line */
 	else{
-		if(x_dist > y_dist){
+		/* Pixels are grouped in runs along the major axis: a run ends when
+		 * the minor coordinate changes, and each run is sent as one span */
+		x_major = (x_dist >= y_dist);
+		if(x_major){
 			error = x_dist / 2;
 		}
 		else{
-			error = y_dist / 2;
+			error = -y_dist / 2;
 		}
+		run_x = x0;
+		run_y = y0;
 
 		while (1){
-			/* Draw start point */
-			ILI9341DrawPixel(x0, y0, color);
 			/* Loop ends when start point reaches end point */
-			if (x0 == x1 || y0 == y1){
+			if (x0 == x1 && y0 == y1){
+				Fill(run_x, run_y, x0, y0, color);
 				break;
 			}
+			prev_x = x0;
+			prev_y = y0;
 			error_2 = error;
 			/* Determine if line must grow in x direction */
 			if (error_2 > -x_dist){
@@ -562,6 +745,12 @@ void ILI9341DrawLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_
 				error += x_dist;
 				y0 += y_grow;	/* Move start point */
 			}
+			/* Minor coordinate changed: send the finished run */
+			if ((x_major && (y0 != prev_y)) || (!x_major && (x0 != prev_x))){
+				Fill(run_x, run_y, prev_x, prev_y, color);
+				run_x = x0;
+				run_y = y0;
+			}
 		}
 	}
 }
@@ -578,72 +767,69 @@ void ILI9341DrawFilledRectangle(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t
 }
 
 void ILI9341DrawCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color){
-	static int16_t f, ddF_x, ddF_y, x, y;
+	static int16_t f, ddF_x, ddF_y, x, y, x_start;
 
 	f = 1 - r;
 	ddF_x = 1;
 	ddF_y = -2 * r;
 	x = 0;
 	y = r;
-
-	ILI9341DrawPixel(x0, y0 + r, color);
-	ILI9341DrawPixel(x0, y0 - r, color);
-	ILI9341DrawPixel(x0 + r, y0, color);
-	ILI9341DrawPixel(x0 - r, y0, color);
-
-    while (x < y){
-        if (f >= 0){
-            y--;
-            ddF_y += 2;
-            f += ddF_y;
-        }
-        x++;
-        ddF_x += 2;
-        f += ddF_x;
-
-        ILI9341DrawPixel(x0 + x, y0 + y, color);
-        ILI9341DrawPixel(x0 - x, y0 + y, color);
-        ILI9341DrawPixel(x0 + x, y0 - y, color);
-        ILI9341DrawPixel(x0 - x, y0 - y, color);
-
-        ILI9341DrawPixel(x0 + y, y0 + x, color);
-        ILI9341DrawPixel(x0 - y, y0 + x, color);
-        ILI9341DrawPixel(x0 + y, y0 - x, color);
-        ILI9341DrawPixel(x0 - y, y0 - x, color);
-    }
+	x_start = 0;
+
+	while (x < y){
+		if (f >= 0){
+			/* y is about to change: send the run accumulated on this row */
+			CircleRuns(x0, y0, x_start, x, y, color);
+			x_start = x + 1;
+			y--;
+			ddF_y += 2;
+			f += ddF_y;
+		}
+		x++;
+		ddF_x += 2;
+		f += ddF_x;
+	}
+	CircleRuns(x0, y0, x_start, x, y, color);
 }
 
 void ILI9341DrawFilledCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color){
-	static int16_t f, ddF_x, ddF_y, x, y;
+	static int16_t f, ddF_x, ddF_y, x, y, x_prev, y_prev;
 
 	f = 1 - r;
 	ddF_x = 1;
 	ddF_y = -2 * r;
 	x = 0;
 	y = r;
-
-    ILI9341DrawPixel(x0, y0 + r, color);
-    ILI9341DrawPixel(x0, y0 - r, color);
-    ILI9341DrawPixel(x0 + r, y0, color);
-    ILI9341DrawPixel(x0 - r, y0, color);
-    ILI9341DrawLine(x0 - r, y0, x0 + r, y0, color);
-
-    while (x < y){
-        if (f >= 0){
-            y--;
-            ddF_y += 2;
-            f += ddF_y;
-        }
-        x++;
-        ddF_x += 2;
-        f += ddF_x;
-
-        ILI9341DrawLine(x0 - x, y0 + y, x0 + x, y0 + y, color);
-        ILI9341DrawLine(x0 + x, y0 - y, x0 - x, y0 - y, color);
-
-        ILI9341DrawLine(x0 + y, y0 + x, x0 - y, y0 + x, color);
-        ILI9341DrawLine(x0 + y, y0 - x, x0 - y, y0 - x, color);
-    }
+	x_prev = x;
+	y_prev = y;
+
+	/* Central column */
+	FillSpan(x0, y0 - r, x0, y0 + r, color);
+
+	/* Each column of the circle is sent once as a vertical span */
+	while (x < y){
+		if (f >= 0){
+			y--;
+			ddF_y += 2;
+			f += ddF_y;
+		}
+		x++;
+		ddF_x += 2;
+		f += ddF_x;
+
+		/* Columns x0 +- x, unless already covered by the x0 +- y ones */
+		if (x < (y + 1)){
+			FillSpan(x0 + x, y0 - y, x0 + x, y0 + y, color);
+			FillSpan(x0 - x, y0 - y, x0 - x, y0 + y, color);
+		}
+		/* Columns x0 +- y, only once for each value of y */
+		if (y != y_prev){
+			FillSpan(x0 + y_prev, y0 - x_prev, x0 + y_prev, y0 + x_prev, color);
+			FillSpan(x0 - y_prev, y0 - x_prev, x0 - y_prev, y0 + x_prev, color);
+			y_prev = y;
+		}
+		x_prev = x;
+	}
 }
 
 void ILI9341DrawTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color){
@@ -653,121 +839,73 @@ void ILI9341DrawTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t
 }
 
 void ILI9341DrawFilledTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color){
-	static int16_t x_0 = 0;
-	static int16_t y_0 = 0;
-	static int16_t x_1 = 0;
-	static int16_t y_1 = 0;
-	static int16_t x_2 = 0;
-	static int16_t y_2 = 0;
-	static int16_t x_aux = 0;
-	static int16_t y_aux = 0;
-	static int16_t scanline_y = 0;
-	float invslope1, invslope2, curx1, curx2;
-	if((y0 <= y1) && (y0 <= y2)){
-		x_0 = x0;
-		y_0 = y0;
-		if(y1 <= y2){
-			x_1 = x1;
-			y_1 = y1;
-			x_2 = x2;
-			y_2 = y2;
-		} else{
-			x_1 = x2;
-			y_1 = y2;
-			x_2 = x1;
-			y_2 = y1;
-		}
-	}else if((y1 <= y2) && (y1 <= y0)){
-		x_0 = x1;
-		y_0 = y1;
-		if(y0 <= y2){
-			x_1 = x0;
-			y_1 = y0;
-			x_2 = x2;
-			y_2 = y2;
-		} else{
-			x_1 = x2;
-			y_1 = y2;
-			x_2 = x0;
-			y_2 = y0;
-		}
-	}else if((y2 <= y1) && (y2 <= y0)){
-		x_0 = x2;
-		y_0 = y2;
-		if(y0 <= y1){
-			x_1 = x0;
-			y_1 = y0;
-			x_2 = x1;
-			y_2 = y1;
-		} else{
-			x_1 = x1;
-			y_1 = y1;
-			x_2 = x0;
-			y_2 = y0;
-		}
+	static int16_t aux, a, b, y, last;
+	static int16_t dx01, dy01, dx02, dy02, dx12, dy12;
+	static int32_t sa, sb;
+
+	/* Sort vertices by row (y0 <= y1 <= y2) */
+	if (y0 > y1){
+		aux = y0; y0 = y1; y1 = aux;
+		aux = x0; x0 = x1; x1 = aux;
+	}
+	if (y1 > y2){
+		aux = y1; y1 = y2; y2 = aux;
+		aux = x1; x1 = x2; x2 = aux;
+	}
+	if (y0 > y1){
+		aux = y0; y0 = y1; y1 = aux;
+		aux = x0; x0 = x1; x1 = aux;
+	}
+
+	/* Degenerate triangle: all vertices on the same row */
+	if (y0 == y2){
+		a = b = x0;
+		if (x1 < a) a = x1;
+		if (x1 > b) b = x1;
+		if (x2 < a) a = x2;
+		if (x2 > b) b = x2;
+		FillSpan(a, y0, b, y0, color);
+		return;
+	}
+
+	dx01 = x1 - x0;
+	dy01 = y1 - y0;
+	dx02 = x2 - x0;
+	dy02 = y2 - y0;
+	dx12 = x2 - x1;
+	dy12 = y2 - y1;
+	sa = 0;
+	sb = 0;
+
+	/* Upper part: edges 0-1 and 0-2. Row y1 is left to the lower part,
+	 * unless the triangle is flat on the bottom */
+	if (y1 == y2){
+		last = y1;
+	}
+	else{
+		last = y1 - 1;
+	}
+	for (y = y0; y <= last; y++){
+		a = x0 + sa / dy01;
+		b = x0 + sb / dy02;
+		sa += dx01;
+		sb += dx02;
+		FillSpan(a, y, b, y, color);
+	}
+
+	/* Lower part: edges 1-2 and 0-2 */
+	sa = (int32_t)dx12 * (y - y1);
+	sb = (int32_t)dx02 * (y - y0);
+	for (; y <= y2; y++){
+		a = x1 + sa / dy12;
+		b = x0 + sb / dy02;
+		sa += dx12;
+		sb += dx02;
+		FillSpan(a, y, b, y, color);
 	}
-	if(y_1 == y_2){
-		// Bottom flat triangle
-		invslope1 = (float)(x_1 - x_0) / (float)(y_1 - y_0);
-		invslope2 = (float)(x_2 - x_0) / (float)(y_2 - y_0);
-		curx1 = x_0;
-		curx2 = x_0;
-		scanline_y = y_0;
-		while(scanline_y < y_1){
-			ILI9341DrawLine((int)curx1, scanline_y, (int)curx2, scanline_y, color);
-			curx1 += invslope1;
-			curx2 += invslope2;
-			scanline_y++;
-		}
-  	}
-  	else if (y_0 == y_1){
-		// Top flat triangle
-		invslope1 = (float)(x_2 - x_0) / (float)(y_2 - y_0);
-		invslope2 = (float)(x_2 - x_1) / (float)(y_2 - y_1);
-		curx1 = x_2;
-		curx2 = x_2;
-		scanline_y = y_2;
-		while(scanline_y > y_0){
-			ILI9341DrawLine((int)curx1, scanline_y, (int)curx2, scanline_y, color);
-			curx1 -= invslope1;
-			curx2 -= invslope2;
-			scanline_y--;
-		}
-  	}
-  	else{
-		// Split in a flat top triangle and a bottom flat triangle
-		x_aux = (int)(x_0 + (float)(y_1 - y_0) / (float)(y_2 - y_0) * (x_2 - x_0));
-		y_aux = y_1;
-		// Bottom flat triangle
-		invslope1 = (float)(x_1 - x_0) / (float)(y_1 - y_0);
-		invslope2 = (float)(x_aux - x_0) / (float)(y_aux - y_0);
-		curx1 = x_0;
-		curx2 = x_0;
-		scanline_y = y_0;
-		while(scanline_y < y_1){
-			ILI9341DrawLine((int)curx1, scanline_y, (int)curx2, scanline_y, color);
-			curx1 += invslope1;
-			curx2 += invslope2;
-			scanline_y++;
-		}
-		// Top flat triangle
-		invslope1 = (float)(x_2 - x_1) / (float)(y_2 - y_1);
-		invslope2 = (float)(x_2 - x_aux) / (float)(y_2 - y_aux);
-		curx1 = x_2;
-		curx2 = x_2;
-		scanline_y = y_2;
-		while(scanline_y > y_1){
-			ILI9341DrawLine((int)curx1, scanline_y, (int)curx2, scanline_y, color);
-			curx1 -= invslope1;
-			curx2 -= invslope2;
-			scanline_y--;
-		}
-		ILI9341DrawLine(x_1, y_1, x_aux, y_aux, color);
-  	}
 }
 
 void ILI9341DrawPicture(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t* pic){
-	static uint16_t i, j;
 	static int32_t bytes_count;
 	static uint8_t pixel[MAX_VALUE_SIZE];
 
@@ -777,22 +915,103 @@ void ILI9341DrawPicture(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
 	bytes_count = width * height * 2;
 
 	/* Start writing LCD memory */
-	lcd_cmd_t lcd_write = {MEM_WRITE, NULL, NULL};
+	lcd_cmd_t lcd_write = {MEM_WRITE, 0, NULL};
 	WriteLCD(&lcd_write);
 
-	j = 0;
 	while(bytes_count - MAX_VALUE_SIZE > 0){
-		for (i = 0; i < MAX_VALUE_SIZE; i++){
-			pixel[i] = pic[j * MAX_VALUE_SIZE + i];
-		}
-		lcd_cmd_t lcd_pixel = {NULL, MAX_VALUE_SIZE, pixel};
+		ILI9341Wait();
+		memcpy(pixel, pic, MAX_VALUE_SIZE);
+		lcd_cmd_t lcd_pixel = {0, MAX_VALUE_SIZE, pixel};
 		WriteLCD(&lcd_pixel);
 		bytes_count -= MAX_VALUE_SIZE;
-		j++;
-	}
-	for (i = 0; i < bytes_count; i++){
-		pixel[i] = pic[j * MAX_VALUE_SIZE + i];
+		pic += MAX_VALUE_SIZE;
 	}
-	lcd_cmd_t lcd_pixel = {NULL, bytes_count, pixel};
+	ILI9341Wait();
+	memcpy(pixel, pic, bytes_count);
+	lcd_cmd_t lcd_pixel = {0, bytes_count, pixel};
 	WriteLCD(&lcd_pixel);
 }
+
+void ILI9341WindowBegin(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1){
+	SetCursorPosition(x0, y0, x1, y1);
+	/* Start writing LCD memory */
+	lcd_cmd_t lcd_write = {MEM_WRITE, 0, NULL};
+	WriteLCD(&lcd_write);
+}
+
+void ILI9341WindowWrite(uint8_t *data, uint32_t bytes){
+	lcd_cmd_t lcd_pixel = {0, bytes, data};
+	WriteLCD(&lcd_pixel);
+	/* The caller can reuse data when this returns */
+	ILI9341Wait();
+}
+
+void ILI9341Wait(void){
+	SpiWaitAll(ili9341_spi);
+}
+
+void ILI9341DrawRlePicture(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t* rle){
+	static int32_t pixel_count;
+	static uint16_t i, color;
+	static uint8_t pixel[MAX_VALUE_SIZE];
+	static ili9341_rle_t reader;
+
+	SetCursorPosition(x, y, x + width - 1, y + height - 1);
+
+	/* Start writing LCD memory */
+	lcd_cmd_t lcd_write = {MEM_WRITE, 0, NULL};
+	WriteLCD(&lcd_write);
+
+	/* Pixels are expanded straight into the transfer buffer */
+	ILI9341Wait();
+	ILI9341RleInit(&reader, rle);
+	pixel_count = width * height;
+	i = 0;
+	while (pixel_count > 0){
+		color = ILI9341RleNext(&reader);
+		pixel[i++] = HighByte(color);
+		pixel[i++] = LowByte(color);
+		pixel_count--;
+		if ((i == MAX_VALUE_SIZE) || (pixel_count == 0)){
+			lcd_cmd_t lcd_pixel = {0, i, pixel};
+			WriteLCD(&lcd_pixel);
+			if (pixel_count > 0){
+				ILI9341Wait();
+			}
+			i = 0;
+		}
+	}
+}
+
+void ILI9341RleInit(ili9341_rle_t *rle, const uint8_t *data){
+	rle->data = data;
+	rle->count = 0;
+	rle->run = false;
+	rle->color = 0;
+}
+
+uint16_t ILI9341RleNext(ili9341_rle_t *rle){
+	uint16_t color;
+
+	/* Start a new packet */
+	if (rle->count == 0){
+		if (*rle->data & 0x80){
+			rle->run = true;
+			rle->count = (*rle->data & 0x7F) + 1;
+			rle->color = (rle->data[1] << 8) | rle->data[2];
+			rle->data += 3;
+		}
+		else{
+			rle->run = false;
+			rle->count = *rle->data + 1;
+			rle->data++;
+		}
+	}
+	rle->count--;
+	if (rle->run){
+		return rle->color;
+	}
+	color = (rle->data[0] << 8) | rle->data[1];
+	rle->data += 2;
+	return color;
+}
@@ -0,0 +1,203 @@
+/**
+ * @file imu_fusion.c
+ * @author Joaquin Palacio
+ * @brief
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+/*==================[inclusions]=============================================*/
+#include "imu_fusion.h"
+/*==================[macros and definitions]=================================*/
+#define ONE_Q30			(1L << 30)
+#define PI_F			3.14159265f
+#define CDEG_90			9000
+#define CDEG_180		18000
+
+/** Q30 product */
+#define MUL_Q30(a, b)	((int32_t)(((int64_t)(a) * (b)) >> 30))
+/*==================[internal data declaration]==============================*/
+
+/*==================[internal functions declaration]=========================*/
+/**
+ * @brief Integer square root
+ */
+static uint32_t Sqrt64(uint64_t x);
+
+/**
+ * @brief atan2 in hundredths of degree, max error 0.01 degree
+ */
+static int16_t Atan2Cdeg(int32_t y, int32_t x);
+
+/*==================[internal data definition]===============================*/
+static const float gyro_lsb_dps[4] = {131.0f, 65.5f, 32.8f, 16.4f};	/**< Gyroscope counts per degree/s of each full scale */
+
+/*==================[external data definition]===============================*/
+
+/*==================[internal functions definition]==========================*/
+static uint32_t Sqrt64(uint64_t x){
+	uint64_t root = 0, bit = 1ULL << 62;
+
+	while (bit > x){
+		bit >>= 2;
+	}
+	while (bit != 0){
+		if (x >= root + bit){
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		} else{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)root;
+}
+
+static int16_t Atan2Cdeg(int32_t y, int32_t x){
+	uint32_t ax = (x < 0) ? -(int64_t)x : x;
+	uint32_t ay = (y < 0) ? -(int64_t)y : y;
+	int32_t z, z2, p, angle;
+
+	if ((ax == 0) && (ay == 0)){
+		return 0;
+	}
+	/* atan of the ratio in [0, 1] (Q15), polynomial from Abramowitz & Stegun 4.4.49 */
+	if (ay <= ax){
+		z = ((uint64_t)ay << 15) / ax;
+	} else{
+		z = ((uint64_t)ax << 15) / ay;
+	}
+	z2 = (z * z) >> 15;
+	p = 683;
+	p = -2790 + ((p * z2) >> 15);
+	p = 5903 + ((p * z2) >> 15);
+	p = -10823 + ((p * z2) >> 15);
+	p = 32763 + ((p * z2) >> 15);
+	/* rad (Q15) to hundredths of degree: 18000 / pi / 32768 = 11459 / 65536 */
+	angle = (((z * p) >> 15) * 11459 + 32768) >> 16;
+	/* Back to the right octant */
+	if (ay > ax){
+		angle = CDEG_90 - angle;
+	}
+	if (x < 0){
+		angle = CDEG_180 - angle;
+	}
+	return (y < 0) ? -angle : angle;
+}
+
+/*==================[external functions definition]==========================*/
+void ImuFusionInit(imu_fusion_t *fusion, uint16_t rate_hz, uint8_t gyro_range, float kp, float ki){
+	fusion->q[0] = ONE_Q30;
+	fusion->q[1] = 0;
+	fusion->q[2] = 0;
+	fusion->q[3] = 0;
+	fusion->e_int[0] = 0;
+	fusion->e_int[1] = 0;
+	fusion->e_int[2] = 0;
+	/* Floating point only here, the update is integer only */
+	fusion->gyro_scale = (int32_t)((float)(1L << 24) * PI_F / 180.0f / gyro_lsb_dps[gyro_range & 0x03] + 0.5f);
+	fusion->half_dt = (uint32_t)(2147483648.0f / rate_hz);
+	fusion->two_kp = (int32_t)(2.0f * kp * 65536.0f);
+	fusion->two_ki_dt = (int32_t)(2.0f * ki / rate_hz * 4294967296.0f);
+	fusion->updates = 0;
+}
+
+void ImuFusionUpdate(imu_fusion_t *fusion, const int16_t accel[3], const int16_t gyro[3]){
+	int32_t q0 = fusion->q[0], q1 = fusion->q[1], q2 = fusion->q[2], q3 = fusion->q[3];
+	int32_t g[3], a[3], half_v[3], half_e[3];
+	int32_t inv;
+	uint32_t norm;
+	int64_t n;
+	uint8_t i;
+
+	/* Angular rate, rad/s (Q24) */
+	for (i = 0; i < 3; i++){
+		g[i] = gyro[i] * fusion->gyro_scale;
+	}
+
+	/* Feedback only with a valid accelerometer measurement */
+	/* Each square fits in int32_t, the sum of three saturated axes (3 * 2^30) only in uint32_t */
+	norm = (uint32_t)((int32_t)accel[0] * accel[0]) + (uint32_t)((int32_t)accel[1] * accel[1]) +
+			(uint32_t)((int32_t)accel[2] * accel[2]);
+	if (norm != 0){
+		/* Normalized accelerometer (Q30). Each |accel[i]| <= norm, so no overflow */
+		norm = Sqrt64(norm);
+		inv = ONE_Q30 / norm;
+		for (i = 0; i < 3; i++){
+			a[i] = accel[i] * inv;
+		}
+		/* Half the estimated direction of gravity */
+		half_v[0] = MUL_Q30(q1, q3) - MUL_Q30(q0, q2);
+		half_v[1] = MUL_Q30(q0, q1) + MUL_Q30(q2, q3);
+		half_v[2] = MUL_Q30(q0, q0) - (ONE_Q30 >> 1) + MUL_Q30(q3, q3);
+		/* Error: cross product between measured and estimated gravity */
+		half_e[0] = MUL_Q30(a[1], half_v[2]) - MUL_Q30(a[2], half_v[1]);
+		half_e[1] = MUL_Q30(a[2], half_v[0]) - MUL_Q30(a[0], half_v[2]);
+		half_e[2] = MUL_Q30(a[0], half_v[1]) - MUL_Q30(a[1], half_v[0]);
+		for (i = 0; i < 3; i++){
+			if (fusion->two_ki_dt != 0){
+				/* Q30 * Q32 -> Q24 */
+				fusion->e_int[i] += ((int64_t)half_e[i] * fusion->two_ki_dt) >> 38;
+				g[i] += fusion->e_int[i];
+			}
+			/* Q30 * Q16 -> Q24 */
+			g[i] += ((int64_t)half_e[i] * fusion->two_kp) >> 22;
+		}
+	}
+
+	/* Rotation in half a period (Q24 * Q32 -> Q30) */
+	for (i = 0; i < 3; i++){
+		g[i] = ((int64_t)g[i] * fusion->half_dt) >> 26;
+	}
+	/* q += q * (0, g) */
+	fusion->q[0] = q0 + (int32_t)((-(int64_t)q1 * g[0] - (int64_t)q2 * g[1] - (int64_t)q3 * g[2]) >> 30);
+	fusion->q[1] = q1 + (int32_t)(((int64_t)q0 * g[0] + (int64_t)q2 * g[2] - (int64_t)q3 * g[1]) >> 30);
+	fusion->q[2] = q2 + (int32_t)(((int64_t)q0 * g[1] - (int64_t)q1 * g[2] + (int64_t)q3 * g[0]) >> 30);
+	fusion->q[3] = q3 + (int32_t)(((int64_t)q0 * g[2] + (int64_t)q1 * g[1] - (int64_t)q2 * g[0]) >> 30);
+
+	/* Normalize. The norm drifts very little each step, so one Newton step of
+	 * 1/sqrt(n) around 1, (3 - n) / 2, is enough and avoids a division */
+	n = 0;
+	for (i = 0; i < 4; i++){
+		n += (int64_t)fusion->q[i] * fusion->q[i];
+	}
+	inv = ((3LL << 30) - (n >> 30)) >> 1;
+	for (i = 0; i < 4; i++){
+		fusion->q[i] = MUL_Q30(fusion->q[i], inv);
+	}
+	fusion->updates++;
+}
+
+void ImuFusionUpdateBatch(imu_fusion_t *fusion, const int16_t *axes, uint16_t n, uint16_t stride){
+	const uint8_t *sample = (const uint8_t *)axes;
+
+	while (n > 0){
+		ImuFusionUpdate(fusion, (const int16_t *)sample, (const int16_t *)sample + 3);
+		sample += stride;
+		n--;
+	}
+}
+
+void ImuFusionGetEuler(const imu_fusion_t *fusion, imu_euler_t *euler){
+	int32_t q0 = fusion->q[0], q1 = fusion->q[1], q2 = fusion->q[2], q3 = fusion->q[3];
+	int32_t sin_pitch;
+
+	/* Both atan2 arguments are halved, which doesn't change the angle */
+	euler->roll = Atan2Cdeg(MUL_Q30(q0, q1) + MUL_Q30(q2, q3),
+			(ONE_Q30 >> 1) - MUL_Q30(q1, q1) - MUL_Q30(q2, q2));
+	euler->yaw = Atan2Cdeg(MUL_Q30(q0, q3) + MUL_Q30(q1, q2),
+			(ONE_Q30 >> 1) - MUL_Q30(q2, q2) - MUL_Q30(q3, q3));
+	/* asin(s) = atan2(s, sqrt(1 - s^2)) */
+	sin_pitch = 2 * (MUL_Q30(q0, q2) - MUL_Q30(q1, q3));
+	if (sin_pitch > ONE_Q30){
+		sin_pitch = ONE_Q30;
+	} else if (sin_pitch < -ONE_Q30){
+		sin_pitch = -ONE_Q30;
+	}
+	euler->pitch = Atan2Cdeg(sin_pitch, Sqrt64((1ULL << 60) - (int64_t)sin_pitch * sin_pitch));
+}
+
+/*==================[end of file]============================================*/
@@ -13,32 +13,147 @@
 #include "mpu6050.h"
 #include "math.h"
 #include <string.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs_flash.h"
+#include "nvs.h"
 /*==================[macros and definitions]=================================*/
 #define I2C_NUM I2C_NUM_0
+#define GYRO_RATE_HZ        1000    /* Gyroscope output rate with DLPF enabled (8 kHz without) */
+#define CALIB_SETTLE_MS     100     /* Samples discarded after the DLPF change */
+#define CALIB_POLL_MS       20      /* FIFO reads while calibrating: 20 samples per burst */
+#define NVS_KEY_OFFSETS     "offsets"
 
 /*==================[internal data definition]===============================*/
 uint8_t devAddr;
 uint8_t buffer[14];
+/** Registers that change on their own or have self clearing bits, never cached */
+static const uint8_t volatile_regs[] = {
+	MPU6050_RA_I2C_SLV4_CTRL, MPU6050_RA_I2C_SLV4_DI, MPU6050_RA_I2C_MST_STATUS,
+	MPU6050_RA_INT_STATUS, MPU6050_RA_MOT_DETECT_STATUS, MPU6050_RA_SIGNAL_PATH_RESET,
+	MPU6050_RA_USER_CTRL, MPU6050_RA_PWR_MGMT_1, MPU6050_RA_BANK_SEL,
+	MPU6050_RA_MEM_START_ADDR, MPU6050_RA_MEM_R_W, MPU6050_RA_FIFO_COUNTH,
+	MPU6050_RA_FIFO_COUNTL, MPU6050_RA_FIFO_R_W
+};
+static uint8_t fifo_batch[MPU6050_FIFO_BATCH * MPU6050_FIFO_RECORD];	/*!< Burst read from the FIFO */
+static mpu6050_sample_t samples[MPU6050_SAMPLE_BUFFER];	/*!< Acquired samples ring buffer */
+static volatile uint16_t sample_write;		/*!< Written by MPU6050_fifoPoll only */
+static volatile uint16_t sample_read;		/*!< Written by MPU6050_fifoGetSample only */
+static uint32_t sample_period_us;			/*!< Sample period of the running acquisition */
+static mpu6050_fifo_stats_t fifo_stats;		/*!< Acquisition statistics */
+static TaskHandle_t int_task;				/*!< Interrupt driven acquisition task */
+static uint8_t int_batch;					/*!< Samples per wakeup of int_task */
+static gpio_t int_gpio;						/*!< Pin of the interrupt handler installed by MPU6050_intStart */
+static bool int_active;						/*!< The handler of int_gpio is installed */
+static volatile uint8_t int_count;			/*!< Data ready interrupts since the last wakeup */
+static volatile int64_t int_time_us;		/*!< Time of the interrupt that woke int_task */
+static void (*int_func_p)(void*);			/*!< Called after the samples are published */
+static void *int_param_p;					/*!< Parameter of int_func_p */
+static uint8_t dmp_packet_size;				/*!< FIFO packet size of the running DMP image, 0 if stopped */
+static uint8_t dmp_buffer[MPU6050_DMP_PACKET_MAX];	/*!< Packet read from the FIFO */
+static const mpu6050_mag_t *mag;			/*!< Magnetometer read by slave 0, NULL if none */
+static const uint8_t hmc5883l_init[] = {
+	0x00, 0x18,		/* CRA: 1 sample averaged, 75 Hz */
+	0x01, 0x20,		/* CRB: +-1.3 Ga */
+	0x02, 0x00		/* Mode: continuous */
+};
+static const uint8_t qmc5883l_init[] = {
+	0x0B, 0x01,		/* SET/RESET period */
+	0x09, 0x1D		/* OSR 512, +-8 G, 200 Hz, continuous */
+};
+/*==================[external data definition]===============================*/
+const mpu6050_mag_t mpu6050_mag_hmc5883l = {
+	.address = 0x1E, .data_reg = 0x03, .axis = {0, 2, 1}, .little_endian = false,	/* X, Z, Y */
+	.init = hmc5883l_init, .init_pairs = sizeof(hmc5883l_init) / 2
+};
+const mpu6050_mag_t mpu6050_mag_qmc5883l = {
+	.address = 0x0D, .data_reg = 0x00, .axis = {0, 1, 2}, .little_endian = true,
+	.init = qmc5883l_init, .init_pairs = sizeof(qmc5883l_init) / 2
+};
+
 /*==================[internal functions declaration]=========================*/
+/**
+ * @brief Data ready interrupt: wakes the acquisition task every int_batch samples
+ */
+static void MPU6050_intIsr(void *param);
 
-/*==================[external functions definition]==========================*/
-void MPU6050_ReadRegister(uint8_t reg, uint8_t *data, uint8_t len){
-	uint8_t dev = 0x68;
-	i2c_cmd_handle_t cmd;
-	I2C_SelectRegister(dev, reg);
+/**
+ * @brief Acquisition task: moves the FIFO to the ring buffer on each wakeup
+ */
+static void MPU6050_intTask(void *param);
+
+/**
+ * @brief Sums samples samples of each axis (accel X, Y, Z, gyro X, Y, Z) read from the FIFO
+ */
+static bool MPU6050_calibCollect(uint16_t samples, int64_t sum[6]);
+
+/*==================[internal functions definition]==========================*/
+static void MPU6050_intIsr(void *param) {
+    BaseType_t woken = pdFALSE;
+
+    if (++int_count >= int_batch) {
+        int_count = 0;
+        int_time_us = esp_timer_get_time();
+        vTaskNotifyGiveFromISR(int_task, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
 
-	cmd = i2c_cmd_link_create();
-	ESP_ERROR_CHECK(i2c_master_start(cmd));
-	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, (dev << 1) | I2C_MASTER_READ, 1));
+static void MPU6050_intTask(void *param) {
+    uint32_t latency;
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        MPU6050_fifoPoll();
+        latency = esp_timer_get_time() - int_time_us;
+        fifo_stats.wakeups++;
+        fifo_stats.latency_last_us = latency;
+        fifo_stats.latency_total_us += latency;
+        if (latency > fifo_stats.latency_max_us) {
+            fifo_stats.latency_max_us = latency;
+        }
+        if (int_func_p != NULL) {
+            int_func_p(int_param_p);
+        }
+    }
+}
 
-	if(len>1)
-		ESP_ERROR_CHECK(i2c_master_read(cmd, data, len, I2C_MASTER_ACK));
+static bool MPU6050_calibCollect(uint16_t samples, int64_t sum[6]) {
+    mpu6050_sample_t s;
+    uint16_t n = 0;
+    int64_t deadline;
 
-	ESP_ERROR_CHECK(i2c_master_read_byte(cmd, data+len-1, I2C_MASTER_NACK));
+    memset(sum, 0, 6 * sizeof(int64_t));
+    MPU6050_fifoStart(GYRO_RATE_HZ, MPU6050_DLPF_BW_42);
+    vTaskDelay(CALIB_SETTLE_MS / portTICK_PERIOD_MS);
+    /* Start over once the filter output has settled */
+    MPU6050_resetFIFO();
+    MPU6050_fifoPoll();
+    while (MPU6050_fifoGetSample(&s)) {
+    }
+    /* Twice the expected time before giving up */
+    deadline = esp_timer_get_time() + 2000LL * samples + 100000;
+    while (n < samples && esp_timer_get_time() < deadline) {
+        vTaskDelay(CALIB_POLL_MS / portTICK_PERIOD_MS);
+        MPU6050_fifoPoll();
+        while (n < samples && MPU6050_fifoGetSample(&s)) {
+            sum[0] += s.ax;
+            sum[1] += s.ay;
+            sum[2] += s.az;
+            sum[3] += s.gx;
+            sum[4] += s.gy;
+            sum[5] += s.gz;
+            n++;
+        }
+    }
+    MPU6050_fifoStop();
+    return n == samples;
+}
 
-	ESP_ERROR_CHECK(i2c_master_stop(cmd));
-	ESP_ERROR_CHECK(i2c_master_cmd_begin(I2C_NUM, cmd, 1000));
-	i2c_cmd_link_delete(cmd);
+/*==================[external functions definition]==========================*/
+void MPU6050_ReadRegister(uint8_t reg, uint8_t *data, uint8_t len){
+	I2C_readBurst(MPU6050_DEFAULT_ADDRESS, reg, len, data, I2C_MASTER_TIMEOUT_MS);
 }
 
 void MPU6050_Address(uint8_t address) {
@@ -47,10 +162,21 @@ void MPU6050_Address(uint8_t address) {
 
 void MPU6050_initialize() {
 	devAddr = MPU6050_DEFAULT_ADDRESS;
+	/* Configuration registers are cached: the setters don't read them back
+	 * over the bus, and writes are sent together at the end */
+	if (I2C_shadowEnable(devAddr)) {
+		for (uint8_t i = 0; i < sizeof(volatile_regs); i++) {
+			I2C_shadowVolatile(devAddr, volatile_regs[i]);
+		}
+		I2C_shadowLoad(devAddr, MPU6050_RA_SMPLRT_DIV, MPU6050_RA_INT_ENABLE - MPU6050_RA_SMPLRT_DIV + 1);
+		I2C_shadowDefer(devAddr, true);
+	}
     MPU6050_setClockSource(MPU6050_CLOCK_PLL_XGYRO);
     MPU6050_setFullScaleGyroRange(MPU6050_GYRO_FS_250);
     MPU6050_setFullScaleAccelRange(MPU6050_ACCEL_FS_2);
     MPU6050_setSleepEnabled(false); // thanks to Jack Elston for pointing this one out!
+	I2C_shadowFlush(devAddr);
+	I2C_shadowDefer(devAddr, false);
 }
 
 /** Verify the I2C connection.
@@ -1759,8 +1885,25 @@ bool MPU6050_getIntDataReadyStatus() {
  * @see MPU6050_RA_ACCEL_XOUT_H
  */
 void MPU6050_getMotion9(int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int16_t* gy, int16_t* gz, int16_t* mx, int16_t* my, int16_t* mz) {
-    MPU6050_getMotion6(ax, ay, az, gx, gy, gz);
-    // TODO: magnetometer integration
+    uint8_t data[MPU6050_MOTION9_LENGTH];
+    int16_t *m[3] = {mx, my, mz};
+
+    if (mag == NULL) {
+        MPU6050_getMotion6(ax, ay, az, gx, gy, gz);
+        *mx = *my = *mz = 0;
+        return;
+    }
+    I2C_readBurst(devAddr, MPU6050_RA_ACCEL_XOUT_H, MPU6050_MOTION9_LENGTH, data, I2C_MASTER_TIMEOUT_MS);
+    *ax = (((int16_t)data[0]) << 8) | data[1];
+    *ay = (((int16_t)data[2]) << 8) | data[3];
+    *az = (((int16_t)data[4]) << 8) | data[5];
+    *gx = (((int16_t)data[8]) << 8) | data[9];
+    *gy = (((int16_t)data[10]) << 8) | data[11];
+    *gz = (((int16_t)data[12]) << 8) | data[13];
+    /* EXT_SENS_DATA, already swapped to MSB first by slave 0 */
+    for (uint8_t i = 0; i < 3; i++) {
+        *m[i] = (((int16_t)data[14 + 2 * mag->axis[i]]) << 8) | data[15 + 2 * mag->axis[i]];
+    }
 }
 /** Get raw 6-axis motion sensor readings (accel/gyro).
  * Retrieves all currently available motion sensor values.
@@ -2399,6 +2542,30 @@ void MPU6050_resetI2CMaster() {
 void MPU6050_resetSensors() {
     I2C_writeBit(devAddr, MPU6050_RA_USER_CTRL, MPU6050_USERCTRL_SIG_COND_RESET_BIT, true);
 }
+/** Get DMP enabled status.
+ * @return Current DMP enabled status
+ * @see MPU6050_RA_USER_CTRL
+ * @see MPU6050_USERCTRL_DMP_EN_BIT
+ */
+bool MPU6050_getDMPEnabled() {
+    I2C_readBit(devAddr, MPU6050_RA_USER_CTRL, MPU6050_USERCTRL_DMP_EN_BIT, buffer, I2C_MASTER_TIMEOUT_MS);
+    return buffer[0];
+}
+/** Set DMP enabled status.
+ * @param enabled New DMP enabled status
+ * @see MPU6050_RA_USER_CTRL
+ * @see MPU6050_USERCTRL_DMP_EN_BIT
+ */
+void MPU6050_setDMPEnabled(bool enabled) {
+    I2C_writeBit(devAddr, MPU6050_RA_USER_CTRL, MPU6050_USERCTRL_DMP_EN_BIT, enabled);
+}
+/** Reset the DMP.
+ * @see MPU6050_RA_USER_CTRL
+ * @see MPU6050_USERCTRL_DMP_RESET_BIT
+ */
+void MPU6050_resetDMP() {
+    I2C_writeBit(devAddr, MPU6050_RA_USER_CTRL, MPU6050_USERCTRL_DMP_RESET_BIT, true);
+}
 
 // PWR_MGMT_1 register
 
@@ -2409,6 +2576,8 @@ void MPU6050_resetSensors() {
  */
 void MPU6050_reset() {
     I2C_writeBit(devAddr, MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_DEVICE_RESET_BIT, true);
+    /* Every register goes back to its reset value */
+    I2C_shadowInvalidate(devAddr);
 }
 /** Get sleep mode status.
  * Setting the SLEEP bit in the register puts the device into very low power
@@ -2727,7 +2896,7 @@ uint8_t MPU6050_getFIFOByte() {
 }
 void MPU6050_getFIFOBytes(uint8_t *data, uint8_t length) {
     if(length > 0){
-        I2C_readBytes(devAddr, MPU6050_RA_FIFO_R_W, length, data, I2C_MASTER_TIMEOUT_MS);
+        I2C_readBurst(devAddr, MPU6050_RA_FIFO_R_W, length, data, I2C_MASTER_TIMEOUT_MS);
     } else {
     	*data = 0;
     }
@@ -2766,4 +2935,467 @@ void MPU6050_setDeviceID(uint8_t id) {
     I2C_writeBits(devAddr, MPU6050_RA_WHO_AM_I, MPU6050_WHO_AM_I_BIT, MPU6050_WHO_AM_I_LENGTH, id);
 }
 
+// BANK_SEL register
+
+void MPU6050_setMemoryBank(uint8_t bank, bool prefetchEnabled, bool userBank) {
+    bank &= 0x1F;
+    if (userBank) bank |= 0x20;
+    if (prefetchEnabled) bank |= 0x40;
+    I2C_writeByte(devAddr, MPU6050_RA_BANK_SEL, bank);
+}
+
+// MEM_START_ADDR register
+
+void MPU6050_setMemoryStartAddress(uint8_t address) {
+    I2C_writeByte(devAddr, MPU6050_RA_MEM_START_ADDR, address);
+}
+
+// MEM_R_W register
+
+bool MPU6050_readMemoryBlock(uint8_t *data, uint16_t dataSize, uint8_t bank, uint8_t address) {
+    uint16_t chunk;
+
+    while (dataSize > 0) {
+        /* MEM_START_ADDR wraps inside the bank */
+        chunk = MPU6050_DMP_MEMORY_BANK_SIZE - address;
+        if (chunk > dataSize) {
+            chunk = dataSize;
+        }
+        MPU6050_setMemoryBank(bank, false, false);
+        MPU6050_setMemoryStartAddress(address);
+        if (!I2C_readBurst(devAddr, MPU6050_RA_MEM_R_W, chunk, data, I2C_MASTER_TIMEOUT_MS)) {
+            return false;
+        }
+        data += chunk;
+        dataSize -= chunk;
+        address = 0;
+        bank++;
+    }
+    return true;
+}
+
+bool MPU6050_writeMemoryBlock(const uint8_t *data, uint16_t dataSize, uint8_t bank, uint8_t address, bool verify) {
+    uint8_t chunk[MPU6050_DMP_MEMORY_CHUNK_SIZE];
+    uint8_t check[MPU6050_DMP_MEMORY_CHUNK_SIZE];
+    uint16_t size;
+
+    while (dataSize > 0) {
+        size = MPU6050_DMP_MEMORY_CHUNK_SIZE;
+        if (size > dataSize) {
+            size = dataSize;
+        }
+        if (size > MPU6050_DMP_MEMORY_BANK_SIZE - address) {
+            size = MPU6050_DMP_MEMORY_BANK_SIZE - address;
+        }
+        memcpy(chunk, data, size);
+        MPU6050_setMemoryBank(bank, false, false);
+        MPU6050_setMemoryStartAddress(address);
+        if (!I2C_writeBytes(devAddr, MPU6050_RA_MEM_R_W, size, chunk)) {
+            return false;
+        }
+        if (verify) {
+            MPU6050_setMemoryStartAddress(address);
+            if (!I2C_readBurst(devAddr, MPU6050_RA_MEM_R_W, size, check, I2C_MASTER_TIMEOUT_MS) ||
+                    memcmp(chunk, check, size) != 0) {
+                return false;
+            }
+        }
+        data += size;
+        dataSize -= size;
+        address += size;
+        /* address is 8 bit: back to 0 at the end of the bank */
+        if (address == 0) {
+            bank++;
+        }
+    }
+    return true;
+}
+
+// DMP_CFG_1, DMP_CFG_2 registers
+
+void MPU6050_setDMPStartAddress(uint16_t address) {
+    uint8_t data[2] = {address >> 8, address & 0xFF};
+
+    I2C_writeBytes(devAddr, MPU6050_RA_DMP_CFG_1, 2, data);
+}
+
+// XA_OFFS_*, XG_OFFS_USR* registers
+
+int16_t MPU6050_getXAccelOffset() {
+    I2C_readBytes(devAddr, MPU6050_RA_XA_OFFS_H, 2, buffer, I2C_MASTER_TIMEOUT_MS);
+    return (((int16_t)buffer[0]) << 8) | buffer[1];
+}
+void MPU6050_setXAccelOffset(int16_t offset) {
+    I2C_writeWord(devAddr, MPU6050_RA_XA_OFFS_H, offset);
+}
+int16_t MPU6050_getYAccelOffset() {
+    I2C_readBytes(devAddr, MPU6050_RA_YA_OFFS_H, 2, buffer, I2C_MASTER_TIMEOUT_MS);
+    return (((int16_t)buffer[0]) << 8) | buffer[1];
+}
+void MPU6050_setYAccelOffset(int16_t offset) {
+    I2C_writeWord(devAddr, MPU6050_RA_YA_OFFS_H, offset);
+}
+int16_t MPU6050_getZAccelOffset() {
+    I2C_readBytes(devAddr, MPU6050_RA_ZA_OFFS_H, 2, buffer, I2C_MASTER_TIMEOUT_MS);
+    return (((int16_t)buffer[0]) << 8) | buffer[1];
+}
+void MPU6050_setZAccelOffset(int16_t offset) {
+    I2C_writeWord(devAddr, MPU6050_RA_ZA_OFFS_H, offset);
+}
+int16_t MPU6050_getXGyroOffset() {
+    I2C_readBytes(devAddr, MPU6050_RA_XG_OFFS_USRH, 2, buffer, I2C_MASTER_TIMEOUT_MS);
+    return (((int16_t)buffer[0]) << 8) | buffer[1];
+}
+void MPU6050_setXGyroOffset(int16_t offset) {
+    I2C_writeWord(devAddr, MPU6050_RA_XG_OFFS_USRH, offset);
+}
+int16_t MPU6050_getYGyroOffset() {
+    I2C_readBytes(devAddr, MPU6050_RA_YG_OFFS_USRH, 2, buffer, I2C_MASTER_TIMEOUT_MS);
+    return (((int16_t)buffer[0]) << 8) | buffer[1];
+}
+void MPU6050_setYGyroOffset(int16_t offset) {
+    I2C_writeWord(devAddr, MPU6050_RA_YG_OFFS_USRH, offset);
+}
+int16_t MPU6050_getZGyroOffset() {
+    I2C_readBytes(devAddr, MPU6050_RA_ZG_OFFS_USRH, 2, buffer, I2C_MASTER_TIMEOUT_MS);
+    return (((int16_t)buffer[0]) << 8) | buffer[1];
+}
+void MPU6050_setZGyroOffset(int16_t offset) {
+    I2C_writeWord(devAddr, MPU6050_RA_ZG_OFFS_USRH, offset);
+}
+void MPU6050_getOffsets(mpu6050_offsets_t *offsets) {
+    uint8_t data[6];
+
+    I2C_readBurst(devAddr, MPU6050_RA_XA_OFFS_H, 6, data, I2C_MASTER_TIMEOUT_MS);
+    for (uint8_t i = 0; i < 3; i++) {
+        offsets->accel[i] = (((int16_t)data[2 * i]) << 8) | data[2 * i + 1];
+    }
+    I2C_readBurst(devAddr, MPU6050_RA_XG_OFFS_USRH, 6, data, I2C_MASTER_TIMEOUT_MS);
+    for (uint8_t i = 0; i < 3; i++) {
+        offsets->gyro[i] = (((int16_t)data[2 * i]) << 8) | data[2 * i + 1];
+    }
+}
+void MPU6050_setOffsets(const mpu6050_offsets_t *offsets) {
+    uint8_t data[6];
+
+    for (uint8_t i = 0; i < 3; i++) {
+        data[2 * i] = offsets->accel[i] >> 8;
+        data[2 * i + 1] = offsets->accel[i] & 0xFF;
+    }
+    I2C_writeBytes(devAddr, MPU6050_RA_XA_OFFS_H, 6, data);
+    for (uint8_t i = 0; i < 3; i++) {
+        data[2 * i] = offsets->gyro[i] >> 8;
+        data[2 * i + 1] = offsets->gyro[i] & 0xFF;
+    }
+    I2C_writeBytes(devAddr, MPU6050_RA_XG_OFFS_USRH, 6, data);
+}
+
+// FIFO acquisition
+
+uint16_t MPU6050_fifoStart(uint16_t rate_hz, uint8_t dlpf_mode) {
+    uint32_t gyro_rate = GYRO_RATE_HZ;
+    uint32_t div;
+
+    MPU6050_setDLPFMode(dlpf_mode);
+    if (dlpf_mode == MPU6050_DLPF_BW_256 || dlpf_mode > MPU6050_DLPF_BW_5) {
+        gyro_rate = 8 * GYRO_RATE_HZ;
+    }
+    /* Sample Rate = Gyroscope Output Rate / (1 + SMPLRT_DIV) */
+    if (rate_hz == 0 || rate_hz > gyro_rate) {
+        rate_hz = gyro_rate;
+    }
+    div = gyro_rate / rate_hz - 1;
+    if (div > UINT8_MAX) {
+        div = UINT8_MAX;
+    }
+    MPU6050_setRate(div);
+    rate_hz = gyro_rate / (div + 1);
+    sample_period_us = 1000000 / rate_hz;
+
+    /* Records hold accel (registers 59-64) then gyro (67-72) */
+    I2C_writeByte(devAddr, MPU6050_RA_FIFO_EN, (1 << MPU6050_XG_FIFO_EN_BIT) | (1 << MPU6050_YG_FIFO_EN_BIT) |
+            (1 << MPU6050_ZG_FIFO_EN_BIT) | (1 << MPU6050_ACCEL_FIFO_EN_BIT));
+    MPU6050_setFIFOEnabled(true);
+    MPU6050_resetFIFO();
+    memset(&fifo_stats, 0, sizeof(fifo_stats));
+    sample_read = sample_write;
+    return rate_hz;
+}
+
+void MPU6050_fifoStop() {
+    MPU6050_setFIFOEnabled(false);
+    I2C_writeByte(devAddr, MPU6050_RA_FIFO_EN, 0);
+}
+
+uint16_t MPU6050_fifoPoll() {
+    uint16_t count, records, pending, added = 0;
+    uint16_t i, next;
+    uint8_t *rec;
+    int64_t t_read;
+
+    count = MPU6050_getFIFOCount();
+    t_read = esp_timer_get_time();
+    /* A full FIFO has overwritten its oldest bytes: records are no longer
+     * aligned, the only way to recover is to start over */
+    if (count >= MPU6050_FIFO_SIZE) {
+        MPU6050_resetFIFO();
+        fifo_stats.overflows++;
+        return 0;
+    }
+    pending = count / MPU6050_FIFO_RECORD;
+    while (pending > 0) {
+        records = (pending > MPU6050_FIFO_BATCH) ? MPU6050_FIFO_BATCH : pending;
+        if (!I2C_readBurst(devAddr, MPU6050_RA_FIFO_R_W, records * MPU6050_FIFO_RECORD, fifo_batch, I2C_MASTER_TIMEOUT_MS)) {
+            break;
+        }
+        fifo_stats.batches++;
+        for (i = 0; i < records; i++) {
+            pending--;
+            fifo_stats.samples++;
+            next = (sample_write + 1) % MPU6050_SAMPLE_BUFFER;
+            if (next == sample_read) {
+                fifo_stats.dropped++;
+                continue;
+            }
+            rec = &fifo_batch[i * MPU6050_FIFO_RECORD];
+            /* The newest record of the FIFO was sampled just before count was read */
+            samples[sample_write].timestamp_us = t_read - (int64_t)pending * sample_period_us;
+            samples[sample_write].ax = (((int16_t)rec[0]) << 8) | rec[1];
+            samples[sample_write].ay = (((int16_t)rec[2]) << 8) | rec[3];
+            samples[sample_write].az = (((int16_t)rec[4]) << 8) | rec[5];
+            samples[sample_write].gx = (((int16_t)rec[6]) << 8) | rec[7];
+            samples[sample_write].gy = (((int16_t)rec[8]) << 8) | rec[9];
+            samples[sample_write].gz = (((int16_t)rec[10]) << 8) | rec[11];
+            sample_write = next;
+            added++;
+        }
+    }
+    return added;
+}
+
+bool MPU6050_fifoGetSample(mpu6050_sample_t *sample) {
+    if (sample_read == sample_write) {
+        return false;
+    }
+    *sample = samples[sample_read];
+    sample_read = (sample_read + 1) % MPU6050_SAMPLE_BUFFER;
+    return true;
+}
+
+uint16_t MPU6050_fifoAvailable() {
+    return (sample_write + MPU6050_SAMPLE_BUFFER - sample_read) % MPU6050_SAMPLE_BUFFER;
+}
+
+uint16_t MPU6050_intStart(gpio_t int_pin, uint16_t rate_hz, uint8_t dlpf_mode, uint8_t batch, void *func_p, void *param_p, uint8_t priority) {
+    int_batch = (batch == 0) ? 1 : (batch > MPU6050_FIFO_BATCH) ? MPU6050_FIFO_BATCH : batch;
+    int_count = 0;
+    int_func_p = func_p;
+    int_param_p = param_p;
+    if (int_task == NULL &&
+            xTaskCreate(MPU6050_intTask, "mpu6050_int", MPU6050_TASK_STACK, NULL, priority, &int_task) != pdPASS) {
+        int_task = NULL;
+        return 0;
+    }
+    rate_hz = MPU6050_fifoStart(rate_hz, dlpf_mode);
+    /* INT active high, push-pull, 50 us pulse on each new sample */
+    MPU6050_setInterruptMode(false);
+    MPU6050_setInterruptDrive(false);
+    MPU6050_setInterruptLatch(false);
+    /* A previous acquisition could be using another pin */
+    if (int_active) {
+        GPIODeactivInt(int_gpio);
+    }
+    GPIOInit(int_pin, GPIO_INPUT);
+    GPIOActivInt(int_pin, MPU6050_intIsr, true, NULL);
+    int_gpio = int_pin;
+    int_active = true;
+    MPU6050_setIntDataReadyEnabled(true);
+    return rate_hz;
+}
+
+void MPU6050_intStop() {
+    MPU6050_setIntDataReadyEnabled(false);
+    MPU6050_fifoStop();
+    if (int_active) {
+        GPIODeactivInt(int_gpio);
+        int_active = false;
+    }
+}
+
+void MPU6050_fifoGetStats(mpu6050_fifo_stats_t *stats) {
+    *stats = fifo_stats;
+}
+
+bool MPU6050_magStart(const mpu6050_mag_t *config) {
+    bool ok = true;
+
+    MPU6050_magStop();
+    /* Bypass: the auxiliary bus is connected to the ESP32 bus */
+    MPU6050_setI2CBypassEnabled(true);
+    for (uint8_t i = 0; i < config->init_pairs && ok; i++) {
+        ok = I2C_writeByte(config->address, config->init[2 * i], config->init[2 * i + 1]);
+    }
+    MPU6050_setI2CBypassEnabled(false);
+    if (!ok) {
+        return false;
+    }
+    MPU6050_setSlaveAddress(0, 0x80 | config->address);	/* bit 7: read */
+    MPU6050_setSlaveRegister(0, config->data_reg);
+    MPU6050_setSlaveDataLength(0, 6);
+    MPU6050_setSlaveWordByteSwap(0, config->little_endian);
+    /* Words start at data_reg, whether it is even or odd */
+    MPU6050_setSlaveWordGroupOffset(0, config->data_reg & 0x01);
+    MPU6050_setSlaveEnabled(0, true);
+    MPU6050_setMasterClockSpeed(13);	/* 400 kHz */
+    MPU6050_setI2CMasterModeEnabled(true);
+    mag = config;
+    return true;
+}
+
+void MPU6050_magStop() {
+    mag = NULL;
+    MPU6050_setI2CMasterModeEnabled(false);
+    MPU6050_setSlaveEnabled(0, false);
+}
+
+bool MPU6050_calibrate(uint16_t samples, mpu6050_offsets_t *offsets) {
+    mpu6050_offsets_t off;
+    uint8_t accel_fs = MPU6050_getFullScaleAccelRange();
+    uint8_t gyro_fs = MPU6050_getFullScaleGyroRange();
+    int64_t sum[6], target, delta;
+    uint8_t dlpf_mode, rate_div;
+    bool ok = true;
+
+    /* The FIFO is enabled by MPU6050_fifoStart, MPU6050_intStart and the
+     * DMP: calibrating would take their samples */
+    if (samples == 0 || MPU6050_getFIFOEnabled()) {
+        return false;
+    }
+    dlpf_mode = MPU6050_getDLPFMode();
+    rate_div = MPU6050_getRate();
+    MPU6050_getOffsets(&off);
+    for (uint8_t round = 0; round < MPU6050_CALIB_ROUNDS; round++) {
+        ok = MPU6050_calibCollect(samples, sum);
+        if (!ok) {
+            break;
+        }
+        for (uint8_t i = 0; i < 3; i++) {
+            /* Accelerometer: 16384 >> fs counts per g, offset 2048 per g.
+             * Bit 0 is reserved, only even corrections are applied */
+            target = (i == 2) ? (16384 >> accel_fs) : 0;
+            delta = (target * samples - sum[i]) * (1 << accel_fs) / (16LL * samples);
+            off.accel[i] += 2 * delta;
+            /* Gyroscope: 131 >> fs counts per dps, offset 32.8 per dps */
+            delta = -sum[3 + i] * (1 << gyro_fs) / (4LL * samples);
+            off.gyro[i] += delta;
+        }
+        MPU6050_setOffsets(&off);
+    }
+    MPU6050_setDLPFMode(dlpf_mode);
+    MPU6050_setRate(rate_div);
+    if (ok && offsets != NULL) {
+        *offsets = off;
+    }
+    return ok;
+}
+
+bool MPU6050_saveOffsets(const mpu6050_offsets_t *offsets) {
+    nvs_handle_t nvs;
+    esp_err_t err;
+
+    if (nvs_flash_init() != ESP_OK || nvs_open(MPU6050_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return false;
+    }
+    err = nvs_set_blob(nvs, NVS_KEY_OFFSETS, offsets, sizeof(mpu6050_offsets_t));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err == ESP_OK;
+}
+
+bool MPU6050_loadOffsets(mpu6050_offsets_t *offsets) {
+    mpu6050_offsets_t off;
+    size_t size = sizeof(off);
+    nvs_handle_t nvs;
+    esp_err_t err;
+
+    if (nvs_flash_init() != ESP_OK || nvs_open(MPU6050_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    err = nvs_get_blob(nvs, NVS_KEY_OFFSETS, &off, &size);
+    nvs_close(nvs);
+    if (err != ESP_OK || size != sizeof(off)) {
+        return false;
+    }
+    MPU6050_setOffsets(&off);
+    if (offsets != NULL) {
+        *offsets = off;
+    }
+    return true;
+}
+
+bool MPU6050_dmpStart(const uint8_t *firmware, uint16_t size, uint16_t start_address, uint8_t packet_size, uint8_t rate_div) {
+    if (size > MPU6050_DMP_MEMORY_BANKS * MPU6050_DMP_MEMORY_BANK_SIZE ||
+            (packet_size != MPU6050_DMP_PACKET_612 && packet_size != MPU6050_DMP_PACKET_20)) {
+        return false;
+    }
+    MPU6050_fifoStop();
+    MPU6050_setDMPEnabled(false);
+    MPU6050_setIntEnabled(0);
+    MPU6050_setFullScaleGyroRange(MPU6050_GYRO_FS_2000);
+    MPU6050_setFullScaleAccelRange(MPU6050_ACCEL_FS_2);
+    MPU6050_setDLPFMode(MPU6050_DLPF_BW_188);
+    MPU6050_setRate(rate_div);
+    if (!MPU6050_writeMemoryBlock(firmware, size, 0, 0, true)) {
+        return false;
+    }
+    MPU6050_setDMPStartAddress(start_address);
+    dmp_packet_size = packet_size;
+    memset(&fifo_stats, 0, sizeof(fifo_stats));
+    /* Only the DMP writes to the FIFO */
+    MPU6050_resetDMP();
+    MPU6050_setFIFOEnabled(true);
+    MPU6050_resetFIFO();
+    MPU6050_setDMPEnabled(true);
+    MPU6050_setIntEnabled(1 << MPU6050_INTERRUPT_DMP_INT_BIT);
+    return true;
+}
+
+void MPU6050_dmpStop() {
+    MPU6050_setIntEnabled(0);
+    MPU6050_setDMPEnabled(false);
+    MPU6050_setFIFOEnabled(false);
+    dmp_packet_size = 0;
+}
+
+bool MPU6050_dmpGetPacket(mpu6050_dmp_packet_t *packet) {
+    uint16_t count;
+
+    if (dmp_packet_size == 0) {
+        return false;
+    }
+    count = MPU6050_getFIFOCount();
+    if (count < dmp_packet_size) {
+        return false;
+    }
+    /* Packets are written whole: a partial one means the FIFO overflowed */
+    if (count >= MPU6050_FIFO_SIZE || (count % dmp_packet_size) != 0) {
+        MPU6050_resetFIFO();
+        fifo_stats.overflows++;
+        return false;
+    }
+    if (!I2C_readBurst(devAddr, MPU6050_RA_FIFO_R_W, dmp_packet_size, dmp_buffer, I2C_MASTER_TIMEOUT_MS)) {
+        return false;
+    }
+    fifo_stats.batches++;
+    if (!MPU6050_dmpParsePacket(dmp_buffer, dmp_packet_size, packet)) {
+        MPU6050_resetFIFO();
+        fifo_stats.overflows++;
+        return false;
+    }
+    fifo_stats.samples++;
+    return true;
+}
+
 /*==================[end of file]============================================*/
@@ -0,0 +1,62 @@
+/**
+ * @file mpu6050_dmp.c
+ * @author Joaquin Palacio
+ * @brief
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+/*==================[inclusions]=============================================*/
+#include "mpu6050_dmp.h"
+/*==================[macros and definitions]=================================*/
+#define NORM_MIN		(3L << 28)		/* 0.75 in Q30, squared norm limits of a valid quaternion */
+#define NORM_MAX		(5L << 28)		/* 1.25 in Q30 */
+
+/** Big endian 16 bit value */
+#define GET_INT16(p)	((int16_t)(((uint16_t)(p)[0] << 8) | (p)[1]))
+/** Big endian 32 bit value */
+#define GET_INT32(p)	((int32_t)(((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | ((uint32_t)(p)[2] << 8) | (p)[3]))
+/*==================[internal data declaration]==============================*/
+
+/*==================[internal functions declaration]=========================*/
+
+/*==================[internal data definition]===============================*/
+
+/*==================[external data definition]===============================*/
+
+/*==================[internal functions definition]==========================*/
+
+/*==================[external functions definition]==========================*/
+bool MPU6050_dmpParsePacket(const uint8_t *data, uint8_t size, mpu6050_dmp_packet_t *packet){
+	int64_t norm = 0;
+	int32_t c;
+	uint8_t i;
+
+	if ((size != MPU6050_DMP_PACKET_612) && (size != MPU6050_DMP_PACKET_20)){
+		return false;
+	}
+	for (i = 0; i < 4; i++){
+		packet->q[i] = GET_INT32(&data[4 * i]);
+		/* Q15 is enough to check the norm */
+		c = packet->q[i] >> 15;
+		norm += (int64_t)c * c;
+	}
+	if ((norm < NORM_MIN) || (norm > NORM_MAX)){
+		return false;
+	}
+	for (i = 0; i < 3; i++){
+		if (size == MPU6050_DMP_PACKET_612){
+			packet->accel[i] = GET_INT16(&data[16 + 2 * i]);
+			packet->gyro[i] = GET_INT16(&data[22 + 2 * i]);
+		} else{
+			packet->gyro[i] = GET_INT16(&data[16 + 4 * i]);
+			packet->accel[i] = GET_INT16(&data[28 + 4 * i]);
+		}
+	}
+	return true;
+}
+
+/*==================[end of file]============================================*/
@@ -0,0 +1,186 @@
+/**
+ * @file sprite_layer.c
+ * @author Joaquin Palacio
+ * @brief
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2026
+ *
+ */
+
+/*==================[inclusions]=============================================*/
+#include <stddef.h>
+#include "sprite_layer.h"
+#include "ili9341.h"
+/*==================[macros and definitions]=================================*/
+#define BUFFER_SIZE		512		/* bytes composed before each write to the LCD */
+/*==================[internal data declaration]==============================*/
+
+/*==================[internal functions declaration]=========================*/
+/**
+ * @brief Adds an area to the dirty area of a layer, clipped to the layer
+ */
+static void MarkDirty(sprite_layer_t *layer, int32_t x0, int32_t y0, int32_t x1, int32_t y1);
+
+/**
+ * @brief Marks the area covered by a sprite as dirty
+ */
+static void MarkSprite(sprite_t *sprite);
+
+/*==================[internal data definition]===============================*/
+static uint8_t pixel[BUFFER_SIZE];			/**< Composed pixels pending to send */
+static ili9341_rle_t reader[SPRITE_LAYER_MAX];	/**< RLE readers of the sprites being rendered */
+static uint32_t reader_pos[SPRITE_LAYER_MAX];	/**< Index of the next pixel of each reader */
+static uint16_t reader_color[SPRITE_LAYER_MAX];	/**< Last pixel read by each reader */
+
+/*==================[external data definition]===============================*/
+
+/*==================[internal functions definition]==========================*/
+static void MarkDirty(sprite_layer_t *layer, int32_t x0, int32_t y0, int32_t x1, int32_t y1){
+	/* Clip to the layer */
+	if (x0 < layer->x){
+		x0 = layer->x;
+	}
+	if (y0 < layer->y){
+		y0 = layer->y;
+	}
+	if (x1 >= layer->x + layer->width){
+		x1 = layer->x + layer->width - 1;
+	}
+	if (y1 >= layer->y + layer->height){
+		y1 = layer->y + layer->height - 1;
+	}
+	if ((x0 > x1) || (y0 > y1)){
+		return;
+	}
+	if (!layer->dirty){
+		layer->x0 = x0;
+		layer->y0 = y0;
+		layer->x1 = x1;
+		layer->y1 = y1;
+		layer->dirty = true;
+	} else{
+		if (x0 < layer->x0) layer->x0 = x0;
+		if (y0 < layer->y0) layer->y0 = y0;
+		if (x1 > layer->x1) layer->x1 = x1;
+		if (y1 > layer->y1) layer->y1 = y1;
+	}
+}
+
+static void MarkSprite(sprite_t *sprite){
+	if (sprite->layer != NULL){
+		MarkDirty(sprite->layer, sprite->x, sprite->y,
+				(int32_t)sprite->x + sprite->width - 1, (int32_t)sprite->y + sprite->height - 1);
+	}
+}
+
+/*==================[external functions definition]==========================*/
+void SpriteLayerInit(sprite_layer_t *layer){
+	layer->n_sprites = 0;
+	layer->dirty = false;
+	ILI9341DrawFilledRectangle(layer->x, layer->y, layer->x + layer->width - 1,
+			layer->y + layer->height - 1, layer->background);
+}
+
+bool SpriteLayerAdd(sprite_layer_t *layer, sprite_t *sprite){
+	if (layer->n_sprites >= SPRITE_LAYER_MAX){
+		return false;
+	}
+	layer->sprites[layer->n_sprites++] = sprite;
+	sprite->layer = layer;
+	if (sprite->visible){
+		MarkSprite(sprite);
+	}
+	return true;
+}
+
+void SpriteSetVisible(sprite_t *sprite, bool visible){
+	/* Nothing to redraw if the state doesn't change */
+	if (sprite->visible != visible){
+		sprite->visible = visible;
+		MarkSprite(sprite);
+	}
+}
+
+void SpriteMove(sprite_t *sprite, uint16_t x, uint16_t y){
+	if ((sprite->x == x) && (sprite->y == y)){
+		return;
+	}
+	if (sprite->visible){
+		MarkSprite(sprite);
+	}
+	sprite->x = x;
+	sprite->y = y;
+	if (sprite->visible){
+		MarkSprite(sprite);
+	}
+}
+
+void SpriteSetPicture(sprite_t *sprite, const uint8_t *pic){
+	if (sprite->pic != pic){
+		sprite->pic = pic;
+		if (sprite->visible){
+			MarkSprite(sprite);
+		}
+	}
+}
+
+void SpriteLayerRender(sprite_layer_t *layer){
+	uint16_t x, y, color, c, i;
+	uint32_t index;
+	uint8_t k;
+	sprite_t *sprite;
+
+	if (!layer->dirty){
+		return;
+	}
+	/* RLE pictures can only be read in order: the area is scanned in raster
+	 * order, so each reader only moves forward */
+	for (k = 0; k < layer->n_sprites; k++){
+		if (layer->sprites[k]->rle){
+			ILI9341RleInit(&reader[k], layer->sprites[k]->pic);
+			reader_pos[k] = 0;
+		}
+	}
+
+	ILI9341WindowBegin(layer->x0, layer->y0, layer->x1, layer->y1);
+	i = 0;
+	for (y = layer->y0; y <= layer->y1; y++){
+		for (x = layer->x0; x <= layer->x1; x++){
+			color = layer->background;
+			for (k = 0; k < layer->n_sprites; k++){
+				sprite = layer->sprites[k];
+				if (!sprite->visible || (x < sprite->x) || (y < sprite->y) ||
+						(x >= sprite->x + sprite->width) || (y >= sprite->y + sprite->height)){
+					continue;
+				}
+				index = (uint32_t)(y - sprite->y) * sprite->width + (x - sprite->x);
+				if (sprite->rle){
+					while (reader_pos[k] <= index){
+						reader_color[k] = ILI9341RleNext(&reader[k]);
+						reader_pos[k]++;
+					}
+					c = reader_color[k];
+				} else{
+					c = (sprite->pic[2 * index] << 8) | sprite->pic[2 * index + 1];
+				}
+				if (!sprite->transparent || (c != sprite->key)){
+					color = c;
+				}
+			}
+			pixel[i++] = color >> 8;
+			pixel[i++] = color & 0xFF;
+			if (i == BUFFER_SIZE){
+				ILI9341WindowWrite(pixel, i);
+				i = 0;
+			}
+		}
+	}
+	if (i > 0){
+		ILI9341WindowWrite(pixel, i);
+	}
+	layer->dirty = false;
+}
+
+/*==================[end of file]============================================*/
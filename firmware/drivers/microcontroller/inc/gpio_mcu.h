@@ -26,6 +26,8 @@
  * |   Date	    | Description                                    						|
  * |:----------:|:----------------------------------------------------------------------|
  * | 23/10/2023 | Document creation		                         						|
+ * | 19/10/2026 | GPIODeactivInt							                         	|
+ * | 19/10/2026 | GPIOActivIntBothEdges						                         	|
  * 
  **/
 
@@ -134,6 +136,22 @@ bool GPIORead(gpio_t pin);
  */
 void GPIOActivInt(gpio_t pin, void *ptr_int_func, bool edge, void *args);
 
+/**
+ * @brief Configure GPIO input interruption on both edges
+ * 
+ * @param pin GPIO number
+ * @param ptr_int_func Pointer to callback function (read the pin to know the edge)
+ * @param args 
+ */
+void GPIOActivIntBothEdges(gpio_t pin, void *ptr_int_func, void *args);
+
+/**
+ * @brief Disable a GPIO input interruption configured with GPIOActivInt
+ * 
+ * @param pin GPIO number
+ */
+void GPIODeactivInt(gpio_t pin);
+
 /**
  * @brief Configure an input glitch filter to a GPIO
  * 
@@ -14,6 +14,19 @@
  * 
  * @note ESP-EDU have 4 I2C connector in the board (J4, J5, J6 and J8), but all of them are routed to the same I2C port.
  *
+ * @note A device can have a shadow register file (I2C_shadowEnable). Registers
+ * written or loaded are then cached: reads of cached registers and the
+ * read-modify-write of I2C_writeBit/I2C_writeBits don't use the bus, and with
+ * I2C_shadowDefer writes are held and sent by I2C_shadowFlush as burst writes
+ * of consecutive registers. Registers that change on their own or have self
+ * clearing bits must be declared with I2C_shadowVolatile. The shadow of a
+ * device must be used from a single task.
+ *
+ * @note Tasks sharing the bus should use the I2C service (I2C_serviceStart):
+ * a bus owner task runs the requests of every task in the order they arrive,
+ * back to back, and notifies each requester when its request ends. It also
+ * keeps latency and throughput statistics of each device.
+ *
  * @author Juan Ignacio Cerrudo
  * 
  * @section changelog
@@ -21,6 +34,9 @@
  * |   Date	    | Description                                    |
  * |:----------:|:-----------------------------------------------|
  * | 30/01/2024 | Document creation		                         |
+ * | 19/10/2026 | Repeated start reads, static command buffer    |
+ * | 19/10/2026 | Shadow register cache                          |
+ * | 19/10/2026 | Bus owner task for requests of several tasks   |
  *
  */
 
@@ -40,6 +56,36 @@
 #define I2C_MASTER_TX_BUF_DISABLE   0           /*!< I2C master doesn't need buffer */
 #define I2C_MASTER_RX_BUF_DISABLE   0           /*!< I2C master doesn't need buffer */
 #define I2C_MASTER_TIMEOUT_MS       1000
+#define I2C_SHADOW_DEVICES          2           /*!< Devices that can have a shadow register file */
+#define I2C_STATS_DEVICES           4           /*!< Devices with statistics of the I2C service */
+/**
+ * @brief Request to the I2C service. It is owned by the caller and must stay
+ * valid until done is true (or func_p is called).
+ */
+typedef struct {
+	uint8_t dev_addr;			/*!< I2C slave device address */
+	uint8_t reg_addr;			/*!< First register address */
+	bool write;					/*!< true: write data, false: read into data */
+	uint8_t *data;				/*!< Data to write or buffer for the read data */
+	uint16_t length;			/*!< Number of bytes (up to 255 for writes) */
+	void (*func_p)(void *);		/*!< Called from the service task when the request ends, NULL for none */
+	void *param_p;				/*!< Parameter of func_p */
+	volatile bool done;			/*!< Set by the service when the request ends */
+	bool ok;					/*!< Result, valid when done */
+	int64_t t_submit;			/*!< Submission time (us), set by I2C_submit */
+} i2c_request_t;
+
+/**
+ * @brief Statistics of the requests run by the I2C service for a device
+ */
+typedef struct {
+	uint32_t requests;			/*!< Requests run */
+	uint32_t bytes;				/*!< Data bytes read or written */
+	uint32_t errors;			/*!< Requests failed */
+	uint32_t bus_time_us;		/*!< Time spent running the requests on the bus */
+	uint64_t latency_total_us;	/*!< Sum of the times from submission to end */
+	uint32_t latency_max_us;	/*!< Longest time from submission to end */
+} i2c_stats_t;
 /*==================[external data declaration]==============================*/
 
 /*==================[external functions declaration]=========================*/
@@ -109,6 +155,17 @@ int8_t I2C_readWord(uint8_t devAddr, uint8_t regAddr, uint16_t *data, uint16_t t
  */
 int8_t I2C_readBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_t *data, uint16_t timeout);
 
+/** @fn I2C_readBurst(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data, uint16_t timeout)
+ * @brief Read a block of consecutive registers in a single transaction (register address, repeated start, data).
+ * @param devAddr I2C slave device address
+ * @param regAddr First register regAddr to read from
+ * @param length Number of bytes to read
+ * @param data Buffer to store read data in
+ * @param timeout Read timeout in milliseconds (0: I2C_MASTER_TIMEOUT_MS)
+ * @return Status of read operation (true = success)
+ */
+bool I2C_readBurst(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data, uint16_t timeout);
+
 /** @fn I2C_writeBit(uint8_t devAddr, uint8_t regAddr, uint8_t bitNum, uint8_t data);
  * @brief write a single bit in an 8-bit device register.
  * @param devAddr I2C slave device address
@@ -165,6 +222,98 @@ bool I2C_writeBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_t *d
  */
 void I2C_SelectRegister(uint8_t devAddr, uint8_t reg);
 
+/** @fn I2C_shadowEnable(uint8_t devAddr)
+ * @brief Create an empty shadow register file for a device (or empty its current one).
+ * @param devAddr I2C slave device address
+ * @return true if created, false if there are already I2C_SHADOW_DEVICES shadows
+ */
+bool I2C_shadowEnable(uint8_t devAddr);
+
+/** @fn I2C_shadowVolatile(uint8_t devAddr, uint8_t regAddr)
+ * @brief Declare a register that is never cached (status, data, FIFO or self clearing bits).
+ * @param devAddr I2C slave device address
+ * @param regAddr Register address
+ */
+void I2C_shadowVolatile(uint8_t devAddr, uint8_t regAddr);
+
+/** @fn I2C_shadowLoad(uint8_t devAddr, uint8_t regAddr, uint16_t length)
+ * @brief Load a block of registers into the shadow with a single burst read.
+ * @param devAddr I2C slave device address
+ * @param regAddr First register address
+ * @param length Number of registers
+ * @return Status of read operation (true = success)
+ */
+bool I2C_shadowLoad(uint8_t devAddr, uint8_t regAddr, uint16_t length);
+
+/** @fn I2C_shadowDefer(uint8_t devAddr, bool defer)
+ * @brief Hold writes to non volatile registers in the shadow until I2C_shadowFlush.
+ * @param devAddr I2C slave device address
+ * @param defer true to hold writes, false to write through
+ */
+void I2C_shadowDefer(uint8_t devAddr, bool defer);
+
+/** @fn I2C_shadowFlush(uint8_t devAddr)
+ * @brief Write the held registers, one burst per run of consecutive registers.
+ * @param devAddr I2C slave device address
+ * @return Status of operation (true = success)
+ */
+bool I2C_shadowFlush(uint8_t devAddr);
+
+/** @fn I2C_shadowInvalidate(uint8_t devAddr)
+ * @brief Forget the cached contents, e.g. after a device reset. Held writes are discarded.
+ * @param devAddr I2C slave device address
+ */
+void I2C_shadowInvalidate(uint8_t devAddr);
+
+/** @fn I2C_serviceStart(uint8_t priority)
+ * @brief Start the I2C service (bus owner task). I2C_initialize must be called first.
+ * @param priority Priority of the bus owner task
+ * @return true if the service is running
+ */
+bool I2C_serviceStart(uint8_t priority);
+
+/** @fn I2C_submit(i2c_request_t *req)
+ * @brief Queue a request to the I2C service, without waiting for it to run.
+ * @param req Request, with device, register, direction, data, length and callback set
+ * @return true if queued
+ */
+bool I2C_submit(i2c_request_t *req);
+
+/** @fn I2C_serviceRead(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data)
+ * @brief Read consecutive registers through the I2C service, waiting for the result.
+ * @param devAddr I2C slave device address
+ * @param regAddr First register address
+ * @param length Number of bytes to read
+ * @param data Buffer to store read data in
+ * @return Status of read operation (true = success)
+ */
+bool I2C_serviceRead(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data);
+
+/** @fn I2C_serviceWrite(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data)
+ * @brief Write consecutive registers through the I2C service, waiting for the result.
+ * @param devAddr I2C slave device address
+ * @param regAddr First register address
+ * @param length Number of bytes to write (up to 255)
+ * @param data Array of bytes to write
+ * @return Status of operation (true = success)
+ */
+bool I2C_serviceWrite(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data);
+
+/** @fn I2C_getStats(uint8_t devAddr, i2c_stats_t *st)
+ * @brief Get the statistics of the requests run by the I2C service for a device.
+ * @note Average latency is latency_total_us / requests, throughput is bytes / bus_time_us.
+ * @param devAddr I2C slave device address
+ * @param st Structure where statistics are copied (zeroed if the device has none)
+ * @return true if the device has statistics
+ */
+bool I2C_getStats(uint8_t devAddr, i2c_stats_t *st);
+
+/** @fn I2C_resetStats(uint8_t devAddr)
+ * @brief Reset the statistics of a device.
+ * @param devAddr I2C slave device address
+ */
+void I2C_resetStats(uint8_t devAddr);
+
 /** @} doxygen end group definition */
 /** @} doxygen end group definition */
 /** @} doxygen end group definition */
@@ -21,12 +21,17 @@
  * |   Date	    | Description                                    						|
  * |:----------:|:----------------------------------------------------------------------|
  * | 09/02/2024 | Document creation		                         						|
+ * | 19/10/2026 | Transaction and byte statistics per device								|
+ * | 19/10/2026 | Queued (asynchronous) transactions										|
+ * | 19/10/2026 | SPI_AUTO transfer mode, per path statistics								|
+ * | 19/10/2026 | D/C line driven by queued transactions									|
  * 
  **/
 /*==================[inclusions]=============================================*/
 #include <stdbool.h>
 #include <stdint.h>
 /*==================[macros]=================================================*/
+#define SPI_AUTO_THRESHOLD	32		/*!< Default largest transfer (bytes) done by polling in SPI_AUTO mode */
 
 /*==================[typedef]================================================*/
 
@@ -56,6 +61,7 @@ typedef enum {
 typedef enum {
 	SPI_POLLING,		/*!< Polling */
 	SPI_INTERRUPT,		/*!< Interrupción */
+	SPI_AUTO,			/*!< Polling up to auto_threshold bytes, interrupt (DMA) for longer transfers */
 } transfer_mode_t;
 
 /**
@@ -68,15 +74,33 @@ typedef struct{
 	transfer_mode_t transfer_mode;	/*!< Transfer mode */
 	void *func_p;					/*!< Pointer to callback function for transaction end */
 	void *param_p;					/*!< Pointer to callback parameter */
+	uint16_t auto_threshold;		/*!< SPI_AUTO: largest transfer (bytes) done by polling, 0: SPI_AUTO_THRESHOLD */
+	bool dc_control;				/*!< Drive dc_gpio from the transactions queued with SpiQueueWriteDC */
+	uint8_t dc_gpio;				/*!< D/C (data/command) GPIO, already initialized as output */
 } spi_mcu_config_t;
+
+/**
+ * @brief SPI traffic statistics of a device, since init or last reset
+ */
+typedef struct{
+	uint32_t transactions;			/*!< Number of transactions (blocking and queued) */
+	uint32_t bytes;					/*!< Bytes transferred on the bus */
+	uint32_t polling;				/*!< Blocking transactions done by polling */
+	uint32_t interrupt;				/*!< Blocking transactions done by interrupt */
+	uint32_t queued;				/*!< Queued transactions */
+} spi_stats_t;
 /*==================[external data declaration]==============================*/
 
 /*==================[external functions declaration]=========================*/
 /**
  * @brief Initialize SPI module with the corresponding configuration
  * 
+ * @note It can be called again for a device already initialized, to change
+ * its configuration. The device is only added to the bus again if the clock
+ * (bitrate or mode) changes.
+ * 
  * @param spi Structure with the module configuration
- * @return uint8_t 
+ * @return uint8_t 0 if the device is ready
  */
 uint8_t SpiInit(spi_mcu_config_t* spi);
 
@@ -108,6 +132,79 @@ void SpiWrite(spi_dev_t device, uint8_t * tx_buffer, uint32_t tx_buffer_size);
  */
 void SpiReadWrite(spi_dev_t device, uint8_t * tx_buffer, uint8_t * rx_buffer, uint32_t buffer_size);
 
+/**
+ * @brief Queue a write to SPI port, without waiting for it to finish
+ * 
+ * @note Up to 8 transactions can be queued per device, if all are in use this
+ * waits for the oldest one to finish. Writes of up to 4 bytes are copied, for
+ * longer ones tx_buffer must stay valid until the transaction ends. The blocking
+ * functions (SpiRead, SpiWrite, SpiReadWrite) wait for all queued transactions
+ * of the device first. Queue functions of a device must be called from a single task.
+ * 
+ * @param device SPI device to write to
+ * @param tx_buffer pointer to buffer where data is stored
+ * @param tx_buffer_size numbers of bytes to write
+ * @param func_p function called (from interrupt) when the transaction ends, NULL for none
+ * @param param_p parameter of func_p
+ * @return true if the transaction was queued
+ */
+bool SpiQueueWrite(spi_dev_t device, uint8_t * tx_buffer, uint32_t tx_buffer_size, void *func_p, void *param_p);
+
+/**
+ * @brief Queue a write to SPI port, setting the D/C line of the device
+ * 
+ * @note The D/C GPIO (dc_gpio in spi_mcu_config_t) is set just before the
+ * transaction starts, from the SPI driver, so a chain of commands and data
+ * (as displays use) can be queued without waiting between them. Same rules as
+ * SpiQueueWrite.
+ * 
+ * @param device SPI device to write to, configured with dc_control
+ * @param dc level of the D/C line during the transaction
+ * @param tx_buffer pointer to buffer where data is stored
+ * @param tx_buffer_size numbers of bytes to write
+ * @param func_p function called (from interrupt) when the transaction ends, NULL for none
+ * @param param_p parameter of func_p
+ * @return true if the transaction was queued
+ */
+bool SpiQueueWriteDC(spi_dev_t device, bool dc, uint8_t * tx_buffer, uint32_t tx_buffer_size, void *func_p, void *param_p);
+
+/**
+ * @brief Queue a read from SPI port, without waiting for it to finish
+ * 
+ * @note Same rules as SpiQueueWrite. rx_buffer is valid after the callback
+ * is called or SpiWaitAll returns.
+ * 
+ * @param device SPI device to read from
+ * @param rx_buffer pointer to buffer where data is stored
+ * @param rx_buffer_size numbers of bytes to read
+ * @param func_p function called (from interrupt) when the transaction ends, NULL for none
+ * @param param_p parameter of func_p
+ * @return true if the transaction was queued
+ */
+bool SpiQueueRead(spi_dev_t device, uint8_t * rx_buffer, uint32_t rx_buffer_size, void *func_p, void *param_p);
+
+/**
+ * @brief Wait until all queued transactions of a device finish
+ * 
+ * @param device SPI device
+ */
+void SpiWaitAll(spi_dev_t device);
+
+/**
+ * @brief Get the traffic statistics of a SPI device
+ * 
+ * @param device SPI device
+ * @param stats pointer to structure where statistics are copied
+ */
+void SpiGetStats(spi_dev_t device, spi_stats_t * stats);
+
+/**
+ * @brief Reset the traffic statistics of a SPI device
+ * 
+ * @param device SPI device
+ */
+void SpiResetStats(spi_dev_t device);
+
 /**
  * @brief De-Initialize SPI module with the corresponding configuration
  * 
@@ -14,6 +14,10 @@
 #include <esp_err.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <freertos/queue.h>
+#include <string.h>
+#include "esp_timer.h"
 //#include "sdkconfig.h"
 
 #include "i2c_mcu.h"
@@ -23,9 +27,192 @@
 #undef ESP_ERROR_CHECK
 #define ESP_ERROR_CHECK(x)   do { esp_err_t rc = (x); if (rc != ESP_OK) { ESP_LOGE("err", "esp_err_t = %d", rc); /*assert(0 && #x);*/} } while(0);
 
+#define I2C_CMD_LINKS	8	/*!< Links of the longest command: start, address, register, start, address, read, read last, stop */
+#define I2C_REGISTERS	256	/*!< Registers of a device with 8-bit register addresses */
+
+#define I2C_SERVICE_QUEUE	16		/*!< Requests that can be waiting for the bus */
+#define I2C_SERVICE_STACK	2048	/*!< Stack of the bus owner task */
+
+/* One bit per register maps */
+#define MAP_TEST(map, reg)	((map)[(reg) >> 3] & (1 << ((reg) & 7)))
+#define MAP_SET(map, reg)	((map)[(reg) >> 3] |= (1 << ((reg) & 7)))
+#define MAP_CLEAR(map, reg)	((map)[(reg) >> 3] &= ~(1 << ((reg) & 7)))
+
+/**
+ * @brief Shadow register file of a device
+ */
+typedef struct {
+	uint8_t dev_addr;						/*!< Device address (0: slot free) */
+	bool defer;								/*!< Writes are held until I2C_shadowFlush */
+	uint8_t value[I2C_REGISTERS];			/*!< Known register contents */
+	uint8_t valid[I2C_REGISTERS / 8];		/*!< value holds the register content */
+	uint8_t dirty[I2C_REGISTERS / 8];		/*!< value not yet written to the device */
+	uint8_t volat[I2C_REGISTERS / 8];		/*!< Register never cached */
+} i2c_shadow_t;
+
 /*==================[internal data definition]===============================*/
+static uint8_t cmd_buffer[I2C_LINK_RECOMMENDED_SIZE(I2C_CMD_LINKS)];	/*!< Storage of the command links, reused by every transaction */
+static SemaphoreHandle_t cmd_mutex;			/*!< Guards cmd_buffer */
+static StaticSemaphore_t cmd_mutex_buffer;
+static i2c_shadow_t shadow[I2C_SHADOW_DEVICES];	/*!< Shadow register files */
+static QueueHandle_t service_queue;			/*!< Requests (i2c_request_t *) waiting for the bus */
+static uint8_t stats_addr[I2C_STATS_DEVICES];	/*!< Device of each statistics entry (0: free) */
+static i2c_stats_t stats[I2C_STATS_DEVICES];	/*!< Statistics of the requests run by the service */
 
 /*==================[internal functions declaration]=========================*/
+/**
+ * @brief Takes the command buffer and starts a command link on it
+ */
+static i2c_cmd_handle_t I2C_CmdCreate(void);
+
+/**
+ * @brief Executes a command link and releases the command buffer
+ * @param timeout timeout in milliseconds (0: I2C_MASTER_TIMEOUT_MS)
+ */
+static esp_err_t I2C_CmdExecute(i2c_cmd_handle_t cmd, uint16_t timeout);
+
+/**
+ * @brief Shadow register file of a device, NULL if it has none
+ */
+static i2c_shadow_t * I2C_ShadowFind(uint8_t devAddr);
+
+/**
+ * @brief Write consecutive registers on the bus
+ */
+static bool I2C_WriteRegisters(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data);
+
+/**
+ * @brief Bus owner task: runs the queued requests one after the other
+ */
+static void I2C_ServiceTask(void *param);
+
+/**
+ * @brief Statistics entry of a device, a new one if it has none (NULL if full)
+ */
+static i2c_stats_t * I2C_StatsFind(uint8_t devAddr);
+
+/**
+ * @brief Completion callback of the blocking service requests
+ */
+static void I2C_RequestDone(void *param);
+
+/**
+ * @brief Submit a request and wait for it to finish
+ */
+static bool I2C_RequestWait(i2c_request_t *req);
+
+/*==================[internal functions definition]==========================*/
+static void I2C_ServiceTask(void *param){
+	i2c_request_t *req;
+	i2c_stats_t *st;
+	int64_t t_start, t_end;
+	void (*func_p)(void *);
+	void *param_p;
+
+	while(true){
+		xQueueReceive(service_queue, &req, portMAX_DELAY);
+		t_start = esp_timer_get_time();
+		if(req->write){
+			req->ok = (req->length <= UINT8_MAX) &&
+					I2C_writeBytes(req->dev_addr, req->reg_addr, req->length, req->data);
+		} else {
+			req->ok = I2C_readBurst(req->dev_addr, req->reg_addr, req->length, req->data, 0);
+		}
+		t_end = esp_timer_get_time();
+		st = I2C_StatsFind(req->dev_addr);
+		if(st != NULL){
+			st->requests++;
+			st->bytes += req->length;
+			st->errors += req->ok ? 0 : 1;
+			st->bus_time_us += t_end - t_start;
+			st->latency_total_us += t_end - req->t_submit;
+			if((t_end - req->t_submit) > st->latency_max_us){
+				st->latency_max_us = t_end - req->t_submit;
+			}
+		}
+		/* Once done is set the caller can reuse the request, it is not
+		 * touched again */
+		func_p = req->func_p;
+		param_p = req->param_p;
+		req->done = true;
+		if(func_p != NULL){
+			func_p(param_p);
+		}
+	}
+}
+
+static i2c_stats_t * I2C_StatsFind(uint8_t devAddr){
+	uint8_t i;
+
+	for(i = 0; i < I2C_STATS_DEVICES; i++){
+		if(stats_addr[i] == devAddr){
+			return &stats[i];
+		}
+	}
+	for(i = 0; i < I2C_STATS_DEVICES; i++){
+		if(stats_addr[i] == 0){
+			stats_addr[i] = devAddr;
+			return &stats[i];
+		}
+	}
+	return NULL;
+}
+
+static void I2C_RequestDone(void *param){
+	xSemaphoreGive((SemaphoreHandle_t)param);
+}
+
+static bool I2C_RequestWait(i2c_request_t *req){
+	StaticSemaphore_t done_buffer;
+	SemaphoreHandle_t done = xSemaphoreCreateBinaryStatic(&done_buffer);
+
+	req->func_p = I2C_RequestDone;
+	req->param_p = done;
+	if(!I2C_submit(req)){
+		return false;
+	}
+	xSemaphoreTake(done, portMAX_DELAY);
+	return req->ok;
+}
+
+static i2c_shadow_t * I2C_ShadowFind(uint8_t devAddr){
+	for(uint8_t i = 0; i < I2C_SHADOW_DEVICES; i++){
+		if((shadow[i].dev_addr != 0) && (shadow[i].dev_addr == devAddr)){
+			return &shadow[i];
+		}
+	}
+	return NULL;
+}
+
+static bool I2C_WriteRegisters(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data){
+	i2c_cmd_handle_t cmd;
+
+	cmd = I2C_CmdCreate();
+	ESP_ERROR_CHECK(i2c_master_start(cmd));
+	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, (devAddr << 1) | I2C_MASTER_WRITE, 1));
+	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, regAddr, 1));
+	ESP_ERROR_CHECK(i2c_master_write(cmd, data, length, 1));
+	ESP_ERROR_CHECK(i2c_master_stop(cmd));
+	return I2C_CmdExecute(cmd, 0) == ESP_OK;
+}
+
+static i2c_cmd_handle_t I2C_CmdCreate(void){
+	xSemaphoreTake(cmd_mutex, portMAX_DELAY);
+	return i2c_cmd_link_create_static(cmd_buffer, sizeof(cmd_buffer));
+}
+
+static esp_err_t I2C_CmdExecute(i2c_cmd_handle_t cmd, uint16_t timeout){
+	esp_err_t err;
+
+	if(timeout == 0){
+		timeout = I2C_MASTER_TIMEOUT_MS;
+	}
+	err = i2c_master_cmd_begin(I2C_NUM, cmd, pdMS_TO_TICKS(timeout));
+	ESP_ERROR_CHECK(err);
+	i2c_cmd_link_delete_static(cmd);
+	xSemaphoreGive(cmd_mutex);
+	return err;
+}
 
 /*==================[external functions definition]==========================*/
 
@@ -45,6 +232,9 @@ bool I2C_initialize( uint32_t clockRateHz )
     };
 
     i2c_param_config(i2c_master_port, &conf);
+    if(cmd_mutex == NULL){
+        cmd_mutex = xSemaphoreCreateMutexStatic(&cmd_mutex_buffer);
+    }
 
     return i2c_driver_install(i2c_master_port, conf.mode, I2C_MASTER_RX_BUF_DISABLE, I2C_MASTER_TX_BUF_DISABLE, 0);
 	return true;
@@ -124,23 +314,66 @@ int8_t I2C_readByte(uint8_t devAddr, uint8_t regAddr, uint8_t *data, uint16_t ti
  * @return I2C_TransferReturn_TypeDef http://downloads.energymicro.com/documentation/doxygen/group__I2C.html
  */
 int8_t I2C_readBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_t *data, uint16_t timeout) {
-	i2c_cmd_handle_t cmd;
-	I2C_SelectRegister(devAddr, regAddr);
+	if(!I2C_readBurst(devAddr, regAddr, length, data, timeout)){
+		return 0;
+	}
+	return length;
+}
 
-	cmd = i2c_cmd_link_create();
+/** Read a block of consecutive registers in a single transaction.
+ * The register address is written and the data read after a repeated start,
+ * so the bus isn't released between both steps.
+ * @param devAddr I2C slave device address
+ * @param regAddr First register regAddr to read from
+ * @param length Number of bytes to read
+ * @param data Buffer to store read data in
+ * @param timeout Read timeout in milliseconds (0: I2C_MASTER_TIMEOUT_MS)
+ * @return Status of read operation (true = success)
+ */
+bool I2C_readBurst(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data, uint16_t timeout) {
+	i2c_cmd_handle_t cmd;
+	i2c_shadow_t *sh = I2C_ShadowFind(devAddr);
+	uint16_t i, cached = 0;
+	bool ok;
+
+	if(length == 0){
+		return false;
+	}
+	/* A burst starting on a volatile register (a FIFO) bypasses the cache */
+	if((sh != NULL) && ((regAddr + length) <= I2C_REGISTERS) && !MAP_TEST(sh->volat, regAddr)){
+		for(i = 0; i < length; i++){
+			if(MAP_TEST(sh->valid, regAddr + i)){
+				cached++;
+			}
+		}
+		if(cached == length){
+			memcpy(data, &sh->value[regAddr], length);
+			return true;
+		}
+	} else {
+		sh = NULL;
+	}
+	cmd = I2C_CmdCreate();
+	ESP_ERROR_CHECK(i2c_master_start(cmd));
+	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, (devAddr << 1) | I2C_MASTER_WRITE, 1));
+	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, regAddr, 1));
+	/* Repeated start */
 	ESP_ERROR_CHECK(i2c_master_start(cmd));
 	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, (devAddr << 1) | I2C_MASTER_READ, 1));
-
-	if(length>1)
-	ESP_ERROR_CHECK(i2c_master_read(cmd, data, length-1, I2C_MASTER_ACK));
-
-	ESP_ERROR_CHECK(i2c_master_read_byte(cmd, data+length-1, I2C_MASTER_NACK));
-
+	ESP_ERROR_CHECK(i2c_master_read(cmd, data, length, I2C_MASTER_LAST_NACK));
 	ESP_ERROR_CHECK(i2c_master_stop(cmd));
-	ESP_ERROR_CHECK(i2c_master_cmd_begin(I2C_NUM, cmd, 1000/portTICK_PERIOD_MS));
-	i2c_cmd_link_delete(cmd);
-
-	return length;
+	ok = (I2C_CmdExecute(cmd, timeout) == ESP_OK);
+	if(ok && (sh != NULL)){
+		/* Registers with held writes read back the value pending to be written */
+		for(i = 0; i < length; i++){
+			if(MAP_TEST(sh->dirty, regAddr + i)){
+				data[i] = sh->value[regAddr + i];
+			} else if(MAP_TEST(sh->valid, regAddr + i)){
+				sh->value[regAddr + i] = data[i];
+			}
+		}
+	}
+	return ok;
 }
 
 bool I2C_writeWord(uint8_t devAddr, uint8_t regAddr, uint16_t data){
@@ -153,13 +386,12 @@ bool I2C_writeWord(uint8_t devAddr, uint8_t regAddr, uint16_t data){
 void I2C_SelectRegister(uint8_t devAddr, uint8_t reg){
 	i2c_cmd_handle_t cmd;
 
-	cmd = i2c_cmd_link_create();
+	cmd = I2C_CmdCreate();
 	ESP_ERROR_CHECK(i2c_master_start(cmd));
 	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, (devAddr << 1) | I2C_MASTER_WRITE, 1));
 	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, reg, 1));
 	ESP_ERROR_CHECK(i2c_master_stop(cmd));
-	ESP_ERROR_CHECK(i2c_master_cmd_begin(I2C_NUM, cmd, 1000/portTICK_PERIOD_MS));
-	i2c_cmd_link_delete(cmd);
+	I2C_CmdExecute(cmd, 0);
 }
 
 /** write a single bit in an 8-bit device register.
@@ -212,18 +444,7 @@ bool I2C_writeBits(uint8_t devAddr, uint8_t regAddr, uint8_t bitStart, uint8_t l
  * @return Status of operation (true = success)
  */
 bool I2C_writeByte(uint8_t devAddr, uint8_t regAddr, uint8_t data) {
-	i2c_cmd_handle_t cmd;
-
-	cmd = i2c_cmd_link_create();
-	ESP_ERROR_CHECK(i2c_master_start(cmd));
-	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, (devAddr << 1) | I2C_MASTER_WRITE, 1));
-	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, regAddr, 1));
-	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, data, 1));
-	ESP_ERROR_CHECK(i2c_master_stop(cmd));
-	ESP_ERROR_CHECK(i2c_master_cmd_begin(I2C_NUM, cmd, 1000/portTICK_PERIOD_MS));
-	i2c_cmd_link_delete(cmd);
-
-	return true;
+	return I2C_writeBytes(devAddr, regAddr, 1, &data);
 }
 
 /** Write single byte to an 8-bit device register.
@@ -234,18 +455,34 @@ bool I2C_writeByte(uint8_t devAddr, uint8_t regAddr, uint8_t data) {
  * @return Status of operation (true = success)
  */
 bool I2C_writeBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_t *data){
-	i2c_cmd_handle_t cmd;
-
-	cmd = i2c_cmd_link_create();
-	ESP_ERROR_CHECK(i2c_master_start(cmd));
-	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, (devAddr << 1) | I2C_MASTER_WRITE, 1));
-	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, regAddr, 1));
-	ESP_ERROR_CHECK(i2c_master_write(cmd, data, length-1, 0));
-	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, data[length-1], 1));
-	ESP_ERROR_CHECK(i2c_master_stop(cmd));
-	i2c_master_cmd_begin(I2C_NUM, cmd, 1000/portTICK_PERIOD_MS);
-	i2c_cmd_link_delete(cmd);
-	return true;
+	i2c_shadow_t *sh = I2C_ShadowFind(devAddr);
+	bool hold;
+	uint16_t i;
+
+	if((sh == NULL) || ((regAddr + length) > I2C_REGISTERS) || MAP_TEST(sh->volat, regAddr)){
+		return I2C_WriteRegisters(devAddr, regAddr, length, data);
+	}
+	/* Writes touching a volatile register always go to the bus */
+	hold = sh->defer;
+	for(i = 0; i < length; i++){
+		if(MAP_TEST(sh->volat, regAddr + i)){
+			hold = false;
+		} else {
+			sh->value[regAddr + i] = data[i];
+			MAP_SET(sh->valid, regAddr + i);
+		}
+	}
+	for(i = 0; i < length; i++){
+		if(hold){
+			MAP_SET(sh->dirty, regAddr + i);
+		} else {
+			MAP_CLEAR(sh->dirty, regAddr + i);
+		}
+	}
+	if(hold){
+		return true;
+	}
+	return I2C_WriteRegisters(devAddr, regAddr, length, data);
 }
 
 
@@ -264,4 +501,154 @@ int8_t I2C_readWord(uint8_t devAddr, uint8_t regAddr, uint16_t *data, uint16_t t
 	return 0;
 }
 
+bool I2C_shadowEnable(uint8_t devAddr){
+	i2c_shadow_t *sh = I2C_ShadowFind(devAddr);
+
+	for(uint8_t i = 0; (sh == NULL) && (i < I2C_SHADOW_DEVICES); i++){
+		if(shadow[i].dev_addr == 0){
+			sh = &shadow[i];
+		}
+	}
+	if(sh == NULL){
+		return false;
+	}
+	memset(sh, 0, sizeof(i2c_shadow_t));
+	sh->dev_addr = devAddr;
+	return true;
+}
+
+void I2C_shadowVolatile(uint8_t devAddr, uint8_t regAddr){
+	i2c_shadow_t *sh = I2C_ShadowFind(devAddr);
+
+	if(sh != NULL){
+		MAP_SET(sh->volat, regAddr);
+		MAP_CLEAR(sh->valid, regAddr);
+		MAP_CLEAR(sh->dirty, regAddr);
+	}
+}
+
+bool I2C_shadowLoad(uint8_t devAddr, uint8_t regAddr, uint16_t length){
+	i2c_shadow_t *sh = I2C_ShadowFind(devAddr);
+	uint8_t data[I2C_REGISTERS];
+	uint16_t i;
+
+	if((sh == NULL) || ((regAddr + length) > I2C_REGISTERS)){
+		return false;
+	}
+	/* Read straight from the bus: registers already in cache are refreshed */
+	for(i = 0; i < length; i++){
+		MAP_CLEAR(sh->valid, regAddr + i);
+	}
+	if(!I2C_readBurst(devAddr, regAddr, length, data, 0)){
+		return false;
+	}
+	for(i = 0; i < length; i++){
+		if(!MAP_TEST(sh->volat, regAddr + i) && !MAP_TEST(sh->dirty, regAddr + i)){
+			sh->value[regAddr + i] = data[i];
+			MAP_SET(sh->valid, regAddr + i);
+		}
+	}
+	return true;
+}
+
+void I2C_shadowDefer(uint8_t devAddr, bool defer){
+	i2c_shadow_t *sh = I2C_ShadowFind(devAddr);
+
+	if(sh != NULL){
+		sh->defer = defer;
+	}
+}
+
+bool I2C_shadowFlush(uint8_t devAddr){
+	i2c_shadow_t *sh = I2C_ShadowFind(devAddr);
+	uint16_t first, last;
+	bool ok = true;
+
+	if(sh == NULL){
+		return false;
+	}
+	/* Each run of consecutive dirty registers is a single burst write */
+	first = 0;
+	while(first < I2C_REGISTERS){
+		if(!MAP_TEST(sh->dirty, first)){
+			first++;
+			continue;
+		}
+		last = first;
+		while((last + 1 < I2C_REGISTERS) && MAP_TEST(sh->dirty, last + 1)){
+			last++;
+		}
+		if(I2C_WriteRegisters(devAddr, first, last - first + 1, &sh->value[first])){
+			for(; first <= last; first++){
+				MAP_CLEAR(sh->dirty, first);
+			}
+		} else {
+			ok = false;
+			first = last + 1;
+		}
+	}
+	return ok;
+}
+
+void I2C_shadowInvalidate(uint8_t devAddr){
+	i2c_shadow_t *sh = I2C_ShadowFind(devAddr);
+
+	if(sh != NULL){
+		memset(sh->valid, 0, sizeof(sh->valid));
+		memset(sh->dirty, 0, sizeof(sh->dirty));
+	}
+}
+
+bool I2C_serviceStart(uint8_t priority){
+	if(service_queue != NULL){
+		return true;
+	}
+	service_queue = xQueueCreate(I2C_SERVICE_QUEUE, sizeof(i2c_request_t *));
+	if(service_queue == NULL){
+		return false;
+	}
+	return xTaskCreate(I2C_ServiceTask, "i2c_service", I2C_SERVICE_STACK, NULL, priority, NULL) == pdPASS;
+}
+
+bool I2C_submit(i2c_request_t *req){
+	if(service_queue == NULL){
+		return false;
+	}
+	req->done = false;
+	req->ok = false;
+	req->t_submit = esp_timer_get_time();
+	return xQueueSend(service_queue, &req, portMAX_DELAY) == pdPASS;
+}
+
+bool I2C_serviceRead(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data){
+	i2c_request_t req = {.dev_addr = devAddr, .reg_addr = regAddr, .write = false,
+			.data = data, .length = length};
+	return I2C_RequestWait(&req);
+}
+
+bool I2C_serviceWrite(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data){
+	i2c_request_t req = {.dev_addr = devAddr, .reg_addr = regAddr, .write = true,
+			.data = data, .length = length};
+	return I2C_RequestWait(&req);
+}
+
+bool I2C_getStats(uint8_t devAddr, i2c_stats_t *st){
+	for(uint8_t i = 0; i < I2C_STATS_DEVICES; i++){
+		if(stats_addr[i] == devAddr){
+			*st = stats[i];
+			return true;
+		}
+	}
+	memset(st, 0, sizeof(i2c_stats_t));
+	return false;
+}
+
+void I2C_resetStats(uint8_t devAddr){
+	for(uint8_t i = 0; i < I2C_STATS_DEVICES; i++){
+		if(stats_addr[i] == devAddr){
+			memset(&stats[i], 0, sizeof(i2c_stats_t));
+		}
+	}
+}
+
 /*==================[end of file]============================================*/
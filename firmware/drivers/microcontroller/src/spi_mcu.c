@@ -13,6 +13,7 @@
 #include "spi_mcu.h"
 #include <stdint.h>
 #include <string.h>
+#include "freertos/FreeRTOS.h"
 #include "driver/spi_master.h"
 #include "gpio_mcu.h"
 /*==================[macros and definitions]=================================*/
@@ -22,8 +23,20 @@
 #define PIN_NUM_CS1		GPIO_19	/*!<  */
 #define PIN_NUM_CS2		GPIO_18	/*!<  */
 #define PIN_NUM_CS3		GPIO_9	/*!<  */
+#define SPI_DEVICES		3		/*!< Number of devices (chip selects) */
+#define SPI_QUEUE_SIZE	8		/*!< Transactions that can be queued per device */
+#define SPI_TXDATA_MAX	4		/*!< Writes up to this size are copied into the transaction */
+
+/**
+ * @brief Queued transaction
+ */
+typedef struct {
+	spi_transaction_t t;		/*!< ESP-IDF transaction */
+	void (*func_p)(void*);		/*!< Completion callback (NULL: none) */
+	void *param_p;				/*!< Completion callback parameter */
+	int8_t dc;					/*!< D/C level during the transaction (-1: not driven) */
+} spi_slot_t;
 /*==================[internal data declaration]==============================*/
-spi_device_handle_t spi_1, spi_2, spi_3;
 const spi_bus_config_t bus_cfg = {
     .miso_io_num = PIN_NUM_MISO,
     .mosi_io_num = PIN_NUM_MOSI,
@@ -32,72 +45,183 @@ const spi_bus_config_t bus_cfg = {
     .quadhd_io_num = -1,
     .max_transfer_sz = 4092
 };
-transfer_mode_t transfer_mode_1, transfer_mode_2, transfer_mode_3;
-void (*spi_1_isr_p)(void*);	/*!<  */
-void (*spi_2_isr_p)(void*);	/*!<  */
-void (*spi_3_isr_p)(void*);	/*!<  */
-void *spi_1_user_data;	    /*!<  */
-void *spi_2_user_data;	    /*!<  */
-void *spi_3_user_data;	    /*!<  */
+static const gpio_t spi_cs[SPI_DEVICES] = {PIN_NUM_CS1, PIN_NUM_CS2, PIN_NUM_CS3};	/*!< Chip select of each device */
+static spi_device_handle_t spi_handle[SPI_DEVICES];	/*!< ESP-IDF handles, indexed by spi_dev_t (NULL: not added) */
+static spi_mcu_config_t spi_config[SPI_DEVICES];	/*!< Configuration of each device */
+static spi_stats_t spi_stats[SPI_DEVICES];	/*!< Traffic statistics, indexed by spi_dev_t */
+static spi_slot_t slot_pool[SPI_DEVICES][SPI_QUEUE_SIZE];	/*!< Queued transactions pool */
+static uint8_t slot_next[SPI_DEVICES];		/*!< Next slot of the pool to use */
+static uint8_t slot_pending[SPI_DEVICES];	/*!< Queued transactions whose result wasn't collected */
 /*==================[internal functions declaration]=========================*/
+/* Queued transactions carry their slot in t->user, blocking ones carry NULL */
+static void IRAM_ATTR spi_post_cb(spi_dev_t device, spi_transaction_t *t){
+	spi_slot_t *slot = t->user;
+	void (*func_p)(void*) = spi_config[device].func_p;
+	if(slot != NULL){
+		if(slot->func_p != NULL){
+			slot->func_p(slot->param_p);
+		}
+	} else if((spi_config[device].transfer_mode != SPI_POLLING) && (func_p != NULL)){
+		func_p(spi_config[device].param_p);
+	}
+}
+static void IRAM_ATTR spi_pre_cb(spi_dev_t device, spi_transaction_t *t){
+	spi_slot_t *slot = t->user;
+	if((slot != NULL) && (slot->dc >= 0) && spi_config[device].dc_control){
+		GPIOState(spi_config[device].dc_gpio, slot->dc);
+	}
+}
+static void IRAM_ATTR spi_1_pre(spi_transaction_t *t){
+	spi_pre_cb(SPI_1, t);
+}
+static void IRAM_ATTR spi_2_pre(spi_transaction_t *t){
+	spi_pre_cb(SPI_2, t);
+}
+static void IRAM_ATTR spi_3_pre(spi_transaction_t *t){
+	spi_pre_cb(SPI_3, t);
+}
+static const transaction_cb_t spi_pre[SPI_DEVICES] = {spi_1_pre, spi_2_pre, spi_3_pre};
 static void IRAM_ATTR spi_1_isr(spi_transaction_t *t){
-	spi_1_isr_p(spi_1_user_data);
+	spi_post_cb(SPI_1, t);
 }
 static void IRAM_ATTR spi_2_isr(spi_transaction_t *t){
-	spi_2_isr_p(spi_2_user_data);
+	spi_post_cb(SPI_2, t);
 }
 static void IRAM_ATTR spi_3_isr(spi_transaction_t *t){
-	spi_3_isr_p(spi_3_user_data);
+	spi_post_cb(SPI_3, t);
 }
+static const transaction_cb_t spi_isr[SPI_DEVICES] = {spi_1_isr, spi_2_isr, spi_3_isr};
+
+/**
+ * @brief Get a free slot of the pool of a device, waiting for the oldest
+ * queued transaction to finish if all are in use. The slot is only taken
+ * from the pool when SpiSlotQueue succeeds
+ */
+static spi_slot_t * SpiSlotGet(spi_dev_t device);
+
+/**
+ * @brief Queue the transaction of a slot
+ */
+static bool SpiSlotQueue(spi_dev_t device, spi_slot_t * slot);
+
+/**
+ * @brief Queue a write, with the D/C line at dc (-1: not driven)
+ */
+static bool SpiQueueWriteSlot(spi_dev_t device, int8_t dc, uint8_t * tx_buffer, uint32_t tx_buffer_size, void *func_p, void *param_p);
+
+/**
+ * @brief Do a blocking transaction, by polling or interrupt according to the
+ * transfer mode of the device and the transaction size
+ */
+static void SpiTransmit(spi_dev_t device, spi_transaction_t * t, uint32_t size);
 /*==================[internal data definition]===============================*/
 
 /*==================[external data definition]===============================*/
 
 /*==================[internal functions definition]==========================*/
+static spi_slot_t * SpiSlotGet(spi_dev_t device){
+    spi_transaction_t *done;
+    spi_slot_t *slot;
+    /* Results come back in order, so the slot to reuse is the oldest one */
+    if(slot_pending[device] == SPI_QUEUE_SIZE){
+        spi_device_get_trans_result(spi_handle[device], &done, portMAX_DELAY);
+        slot_pending[device]--;
+    }
+    slot = &slot_pool[device][slot_next[device]];
+    memset(&slot->t, 0, sizeof(slot->t));
+    slot->t.user = slot;
+    slot->dc = -1;
+    return slot;
+}
+
+static bool SpiSlotQueue(spi_dev_t device, spi_slot_t * slot){
+    if(spi_device_queue_trans(spi_handle[device], &slot->t, portMAX_DELAY) != ESP_OK){
+        /* The slot stays free: it wasn't handed to the driver */
+        return false;
+    }
+    slot_next[device] = (slot_next[device] + 1) % SPI_QUEUE_SIZE;
+    slot_pending[device]++;
+    spi_stats[device].transactions++;
+    spi_stats[device].queued++;
+    spi_stats[device].bytes += slot->t.length / 8;
+    return true;
+}
+
+static bool SpiQueueWriteSlot(spi_dev_t device, int8_t dc, uint8_t * tx_buffer, uint32_t tx_buffer_size, void *func_p, void *param_p){
+    spi_slot_t *slot = SpiSlotGet(device);
+    slot->func_p = func_p;
+    slot->param_p = param_p;
+    slot->dc = dc;
+    slot->t.length = tx_buffer_size * 8;
+    if(tx_buffer_size <= SPI_TXDATA_MAX){
+        /* Small writes are copied, the caller can reuse its buffer right away */
+        slot->t.flags = SPI_TRANS_USE_TXDATA;
+        memcpy(slot->t.tx_data, tx_buffer, tx_buffer_size);
+    } else {
+        slot->t.tx_buffer = tx_buffer;
+    }
+    return SpiSlotQueue(device, slot);
+}
+
+static void SpiTransmit(spi_dev_t device, spi_transaction_t * t, uint32_t size){
+    bool polling;
+    /* Blocking transfers can't be mixed with queued ones still in progress */
+    SpiWaitAll(device);
+    switch(spi_config[device].transfer_mode){
+        case SPI_POLLING:
+            polling = true;
+            break;
+        case SPI_AUTO:
+            /* Short transfers finish before an interrupt could even be serviced */
+            polling = (size <= spi_config[device].auto_threshold);
+            break;
+        default:
+            polling = false;
+            break;
+    }
+    spi_stats[device].transactions++;
+    spi_stats[device].bytes += size;
+    if(polling){
+        spi_stats[device].polling++;
+        spi_device_polling_transmit(spi_handle[device], t);
+    } else {
+        spi_stats[device].interrupt++;
+        spi_device_transmit(spi_handle[device], t);
+    }
+}
 
 /*==================[external functions definition]==========================*/
 uint8_t SpiInit(spi_mcu_config_t* spi){
     static bool spi_initialized = false;
+    spi_dev_t device = spi->device;
+    spi_device_handle_t handle = spi_handle[device];
     if(!spi_initialized){
 	    spi_bus_initialize(SPI2_HOST, &bus_cfg, SPI_DMA_CH_AUTO);
         spi_initialized = true;
     }
-	spi_device_interface_config_t dev_cfg = {
-        .clock_speed_hz = spi->bitrate,     	
-        .mode = spi->clk_mode,                  
-        .queue_size = 8,                        
-    };
-    switch(spi->device){
-        case SPI_1:
-            dev_cfg.spics_io_num = PIN_NUM_CS1;
-            transfer_mode_1 = spi->transfer_mode;
-            if(transfer_mode_1 == SPI_INTERRUPT){
-                dev_cfg.post_cb = spi_1_isr;
-            } 
-            spi_bus_add_device(SPI2_HOST, &dev_cfg, &spi_1);
-            spi_1_isr_p = spi->func_p;
-            spi_1_user_data = spi->param_p;
-            break;
-        case SPI_2:
-            dev_cfg.spics_io_num = PIN_NUM_CS2;
-            if(transfer_mode_2 == SPI_INTERRUPT){
-                dev_cfg.post_cb = spi_2_isr;
-            } 
-            transfer_mode_1 = spi->transfer_mode;
-            spi_bus_add_device(SPI2_HOST, &dev_cfg, &spi_2);
-            spi_2_isr_p = spi->func_p;
-            spi_2_user_data = spi->param_p;
-            break;
-        case SPI_3:
-            dev_cfg.spics_io_num = PIN_NUM_CS3;
-            if(transfer_mode_3 == SPI_INTERRUPT){
-                dev_cfg.post_cb = spi_3_isr;
-            } 
-            transfer_mode_1 = spi->transfer_mode;
-            spi_bus_add_device(SPI2_HOST, &dev_cfg, &spi_3);
-            spi_3_isr_p = spi->func_p;
-            spi_3_user_data = spi->param_p;
-            break;
+    /* The bus device only has to be added again if the clock changes */
+    if((handle != NULL) && ((spi->bitrate != spi_config[device].bitrate) ||
+            (spi->clk_mode != spi_config[device].clk_mode))){
+        SpiDeInit(device);
+        handle = NULL;
+    }
+    spi_config[device] = *spi;
+    if(spi_config[device].auto_threshold == 0){
+        spi_config[device].auto_threshold = SPI_AUTO_THRESHOLD;
+    }
+    if(handle == NULL){
+        spi_device_interface_config_t dev_cfg = {
+            .clock_speed_hz = spi->bitrate,
+            .mode = spi->clk_mode,
+            .spics_io_num = spi_cs[device],
+            .queue_size = SPI_QUEUE_SIZE,
+            .pre_cb = spi_pre[device],
+            .post_cb = spi_isr[device],
+        };
+        if(spi_bus_add_device(SPI2_HOST, &dev_cfg, &spi_handle[device]) != ESP_OK){
+            spi_handle[device] = NULL;
+            return 1;
+        }
     }
     return 0;
 }
@@ -108,38 +232,7 @@ void SpiRead(spi_dev_t device, uint8_t * rx_buffer, uint32_t rx_buffer_size){
     t.length = rx_buffer_size * 8;  // tx_buffer_size is in bytes, transaction length is in bits.
     t.rxlength = rx_buffer_size * 8;
     t.rx_buffer = rx_buffer;        // Data
-    switch(device){
-        case SPI_1:
-            switch(transfer_mode_1){
-                case SPI_POLLING:
-                    spi_device_polling_transmit(spi_1, &t); 
-                    break;
-                case SPI_INTERRUPT:
-                    spi_device_transmit(spi_1, &t); 
-                    break;
-            }
-            break;
-        case SPI_2:
-            switch(transfer_mode_2){
-                case SPI_POLLING:
-                    spi_device_polling_transmit(spi_2, &t); 
-                    break;
-                case SPI_INTERRUPT:
-                    spi_device_transmit(spi_2, &t); 
-                    break;
-            }
-            break;
-        case SPI_3:
-            switch(transfer_mode_3){
-                case SPI_POLLING:
-                    spi_device_polling_transmit(spi_3, &t); 
-                    break;
-                case SPI_INTERRUPT:
-                    spi_device_transmit(spi_3, &t); 
-                    break;
-            }
-            break;
-    }
+    SpiTransmit(device, &t, rx_buffer_size);
 }
 
 void SpiWrite(spi_dev_t device, uint8_t * tx_buffer, uint32_t tx_buffer_size){
@@ -147,38 +240,7 @@ void SpiWrite(spi_dev_t device, uint8_t * tx_buffer, uint32_t tx_buffer_size){
     memset(&t, 0, sizeof(t));       // Zero out the transaction
     t.length = tx_buffer_size * 8;  // tx_buffer_size is in bytes, transaction length is in bits.
     t.tx_buffer = tx_buffer;        // Data
-    switch(device){
-        case SPI_1:
-            switch(transfer_mode_1){
-                case SPI_POLLING:
-                    spi_device_polling_transmit(spi_1, &t); 
-                    break;
-                case SPI_INTERRUPT:
-                    spi_device_transmit(spi_1, &t); 
-                    break;
-            }
-            break;
-        case SPI_2:
-            switch(transfer_mode_2){
-                case SPI_POLLING:
-                    spi_device_polling_transmit(spi_2, &t); 
-                    break;
-                case SPI_INTERRUPT:
-                    spi_device_transmit(spi_2, &t); 
-                    break;
-            }
-            break;
-        case SPI_3:
-            switch(transfer_mode_3){
-                case SPI_POLLING:
-                    spi_device_polling_transmit(spi_3, &t); 
-                    break;
-                case SPI_INTERRUPT:
-                    spi_device_transmit(spi_3, &t); 
-                    break;
-            }
-            break;
-    }
+    SpiTransmit(device, &t, tx_buffer_size);
 }
 
 void SpiReadWrite(spi_dev_t device, uint8_t * tx_buffer, uint8_t * rx_buffer, uint32_t buffer_size){
@@ -188,41 +250,49 @@ void SpiReadWrite(spi_dev_t device, uint8_t * tx_buffer, uint8_t * rx_buffer, ui
     t.rxlength = buffer_size * 8;
     t.tx_buffer = tx_buffer;        // Data
     t.rx_buffer = rx_buffer;        
-    switch(device){
-        case SPI_1:
-            switch(transfer_mode_1){
-                case SPI_POLLING:
-                    spi_device_polling_transmit(spi_1, &t); 
-                    break;
-                case SPI_INTERRUPT:
-                    spi_device_transmit(spi_1, &t); 
-                    break;
-            }
-            break;
-        case SPI_2:
-            switch(transfer_mode_2){
-                case SPI_POLLING:
-                    spi_device_polling_transmit(spi_2, &t); 
-                    break;
-                case SPI_INTERRUPT:
-                    spi_device_transmit(spi_2, &t); 
-                    break;
-            }
-            break;
-        case SPI_3:
-            switch(transfer_mode_3){
-                case SPI_POLLING:
-                    spi_device_polling_transmit(spi_3, &t); 
-                    break;
-                case SPI_INTERRUPT:
-                    spi_device_transmit(spi_3, &t); 
-                    break;
-            }
-            break;
+    SpiTransmit(device, &t, buffer_size);
+}
+
+bool SpiQueueWrite(spi_dev_t device, uint8_t * tx_buffer, uint32_t tx_buffer_size, void *func_p, void *param_p){
+    return SpiQueueWriteSlot(device, -1, tx_buffer, tx_buffer_size, func_p, param_p);
+}
+
+bool SpiQueueWriteDC(spi_dev_t device, bool dc, uint8_t * tx_buffer, uint32_t tx_buffer_size, void *func_p, void *param_p){
+    return SpiQueueWriteSlot(device, dc, tx_buffer, tx_buffer_size, func_p, param_p);
+}
+
+bool SpiQueueRead(spi_dev_t device, uint8_t * rx_buffer, uint32_t rx_buffer_size, void *func_p, void *param_p){
+    spi_slot_t *slot = SpiSlotGet(device);
+    slot->func_p = func_p;
+    slot->param_p = param_p;
+    slot->t.length = rx_buffer_size * 8;
+    slot->t.rxlength = rx_buffer_size * 8;
+    slot->t.rx_buffer = rx_buffer;
+    return SpiSlotQueue(device, slot);
+}
+
+void SpiWaitAll(spi_dev_t device){
+    spi_transaction_t *done;
+    while(slot_pending[device] > 0){
+        spi_device_get_trans_result(spi_handle[device], &done, portMAX_DELAY);
+        slot_pending[device]--;
     }
 }
 
+void SpiGetStats(spi_dev_t device, spi_stats_t * stats){
+    *stats = spi_stats[device];
+}
+
+void SpiResetStats(spi_dev_t device){
+    memset(&spi_stats[device], 0, sizeof(spi_stats_t));
+}
+
 uint8_t SpiDeInit(spi_dev_t device){
+    if(spi_handle[device] != NULL){
+        SpiWaitAll(device);
+        spi_bus_remove_device(spi_handle[device]);
+        spi_handle[device] = NULL;
+    }
     return 0;
 }
 
@@ -80,12 +80,37 @@
 #include "rtc_mcu.h"
 #include "ili9341.h"
 #include "roll_plot.h"
+#include "sprite_layer.h"
 #include "heart_pic.h"
 
 /*==================[macros and definitions]=================================*/
-#define CHUNK               16 
 #define LIGHT_BLUE_COLOR    0x0B2F
 
+/** @def PPG_OFFSET
+ * @brief valor que se resta a la señal para centrarla en la gráfica
+*/
+#define PPG_OFFSET 1850
+
+/** @def PPG_BUFFER_SIZE
+ * @brief cantidad de muestras que puede acumular el buffer entre graficaciones (potencia de 2)
+*/
+#define PPG_BUFFER_SIZE 64
+
+/** @def N_TRAZAS
+ * @brief cantidad de trazas en la gráfica: señal cruda, señal filtrada y umbral de detección
+*/
+#define N_TRAZAS 3
+
+/** @def FILTRO_SHIFT
+ * @brief constante del filtro pasa bajos de la traza filtrada (alfa = 1/2^FILTRO_SHIFT)
+*/
+#define FILTRO_SHIFT 3
+
+/** @def REFRESH_TICKS
+ * @brief cantidad de periodos del timer de gráfica entre actualizaciones de los datos en display
+*/
+#define REFRESH_TICKS 16
+
 
 /** @def FS
  * @brief Frecuencia en Hz a la que se muestrea la sañal analógica
@@ -137,10 +162,30 @@ HeartRateMonitor hr_monitor =
     .threshSetting = TRESHOLD
 };
 
-/** @var ppg 
- * @brief variable en la que se almacena el valor actual de la señal
+/** @var ppg_buffer 
+ * @brief buffer circular con las muestras pendientes de graficar (cruda, filtrada y umbral)
+ * */
+int16_t ppg_buffer[PPG_BUFFER_SIZE][N_TRAZAS];
+
+/** @var plot_spans 
+ * @brief filas ocupadas por las trazas en cada columna de la gráfica, para reescribir sólo las que cambian
+ * */
+plot_span_t plot_spans[240];
+
+/** @var ppg_filtrada 
+ * @brief salida del filtro pasa bajos, escalada en 2^FILTRO_SHIFT
+ * */
+int32_t ppg_filtrada = PPG_OFFSET << FILTRO_SHIFT;
+
+/** @var ppg_write 
+ * @brief indice de escritura de ppg_buffer (solo lo modifica ProcessSignal)
+ * */
+volatile uint8_t ppg_write = 0;
+
+/** @var ppg_read 
+ * @brief indice de lectura de ppg_buffer (solo lo modifica PlotTask)
  * */
-uint16_t ppg;
+volatile uint8_t ppg_read = 0;
 
 /** @var frecuencia_cardiaca 
  * @brief variable que almacena la frecuencia cardiaca actual
@@ -263,6 +308,16 @@ static void ProcessSignal(void *pvParameters)
         {
             AnalogInputReadSingle(hr_monitor.ch, &hr_monitor.Signal);
             processLatestSample(&hr_monitor);
+            /* Filtrado de señal */
+            ppg_filtrada += getLatestSample(&hr_monitor) - (ppg_filtrada >> FILTRO_SHIFT);
+            /* Muestras para graficar, si el buffer está lleno se descartan */
+            if ((uint8_t)(ppg_write - ppg_read) < PPG_BUFFER_SIZE)
+            {
+                ppg_buffer[ppg_write % PPG_BUFFER_SIZE][0] = getLatestSample(&hr_monitor) - PPG_OFFSET;
+                ppg_buffer[ppg_write % PPG_BUFFER_SIZE][1] = (ppg_filtrada >> FILTRO_SHIFT) - PPG_OFFSET;
+                ppg_buffer[ppg_write % PPG_BUFFER_SIZE][2] = hr_monitor.thresh - PPG_OFFSET;
+                ppg_write++;
+            }
             if (count == 0)
             {
                 UartSendString(UART_PC, "S\r\n");   
@@ -347,10 +402,36 @@ static void PlotTask(void *pvParameter){
 
 
         static uint8_t indice = 0;
-        static char freq[] = "000";
+        static int16_t ppg_block[PPG_BUFFER_SIZE][N_TRAZAS];
+        uint8_t n;
         static char hour_min[] = "00:00";
         static bool beat = true;
         rtc_t actual_time;
+        ili9341_text_t freq_widget, clock_widget;
+
+        /* Textos que solo se redibujan en los caracteres que cambian */
+        ILI9341TextInit(&freq_widget, 20, 60, &font_89, LIGHT_BLUE_COLOR, ILI9341_WHITE);
+        ILI9341TextInit(&clock_widget, 10, 8, &font_30, ILI9341_WHITE, LIGHT_BLUE_COLOR);
+
+        /* Capa con el corazón que parpadea */
+        sprite_layer_t heart_layer = {
+            .x = 170,
+            .y = 65,
+            .width = HEART_WIDTH,
+            .height = HEART_HEIGHT,
+            .background = ILI9341_WHITE
+        };
+        sprite_t heart_sprite = {
+            .x = 170,
+            .y = 65,
+            .width = HEART_WIDTH,
+            .height = HEART_HEIGHT,
+            .pic = heart,
+            .rle = true,
+            .visible = false
+        };
+        SpriteLayerInit(&heart_layer);
+        SpriteLayerAdd(&heart_layer, &heart_sprite);
 
         /* Configuración de área de gráfica */
         plot_t plot1 = {
@@ -358,47 +439,60 @@ static void PlotTask(void *pvParameter){
             .y_pos = 160,
             .width = 240,
             .height = 100,
-            .x_scale = 30,
-            .back_color = ILI9341_WHITE
+            .x_scale = 38,
+            .back_color = ILI9341_WHITE,
+            .spans = plot_spans
         };
         RTPlotInit(&plot1); 
-        /* Configuración de señal a graficar */
-        signal_t ecg1 = {
+        /* Configuración de señales a graficar, en el orden de ppg_buffer */
+        signal_t ppg_cruda = {
+            .y_scale = 40,
+            .y_offset = 50,
+            .color = ILI9341_LIGHTGREY,
+            .x_prev = 0,
+            .y_prev = 0
+        };
+        signal_t ppg_filt = {
             .y_scale = 40,
             .y_offset = 50,
             .color = ILI9341_RED,
             .x_prev = 0,
             .y_prev = 0
         };
-        RTSignalInit(&plot1, &ecg1);
+        signal_t umbral = {
+            .y_scale = 40,
+            .y_offset = 50,
+            .color = ILI9341_BLUE,
+            .x_prev = 0,
+            .y_prev = 0
+        };
+        RTSignalInit(&plot1, &ppg_cruda);
+        RTSignalInit(&plot1, &ppg_filt);
+        RTSignalInit(&plot1, &umbral);
 
         while(true){
             ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
             frecuencia_cardiaca = getBeatsPerMinute(&hr_monitor);
-            ppg = getLatestSample(&hr_monitor);
-            ppg = ppg - 1850;
-            /* Filtrado de señal */
 
-            /* Graficación de señal */
-            for(uint8_t i=0; i<CHUNK; i++){
-                RTPlotDraw(&ecg1, ppg);
+            /* Graficación de todas las muestras adquiridas desde el último periodo,
+             * las tres trazas se componen y envían juntas */
+            n = 0;
+            while(ppg_read != ppg_write){
+                memcpy(ppg_block[n++], ppg_buffer[ppg_read % PPG_BUFFER_SIZE], sizeof(ppg_block[0]));
+                ppg_read++;
             }
-            indice +=CHUNK;
+            RTPlotDrawTraces(&plot1, &ppg_block[0][0], n);
 
-            if(indice == 0){
+            if(++indice == REFRESH_TICKS){
+                indice = 0;
                 /* Actualización de datos en display */
-                ILI9341DrawString(20, 60, freq, &font_89, ILI9341_WHITE, ILI9341_WHITE);
-                ILI9341DrawString(10, 8, hour_min, &font_30, LIGHT_BLUE_COLOR, LIGHT_BLUE_COLOR);
-                sprintf(freq, "%03i", frecuencia_cardiaca);
+                ILI9341TextUpdateInt(&freq_widget, frecuencia_cardiaca, 3);
                 RtcRead(&actual_time);
                 sprintf(hour_min, "%02i:%02i", actual_time.hour%MAX_HOUR, actual_time.min%MAX_MIN);
-                ILI9341DrawString(20, 60, freq, &font_89, LIGHT_BLUE_COLOR, ILI9341_WHITE);
-                ILI9341DrawString(10, 8, hour_min, &font_30, ILI9341_WHITE, LIGHT_BLUE_COLOR);
-                if(beat){
-                    ILI9341DrawPicture(170, 65, HEART_WIDTH, HEART_HEIGHT, heart);
-                }else{
-                    ILI9341DrawFilledRectangle(170, 65, 170+HEART_WIDTH, 65+HEART_HEIGHT, ILI9341_WHITE);
-                }
+                ILI9341TextUpdate(&clock_widget, hour_min);
+                /* Un solo envío al display por cada cambio de estado del corazón */
+                SpriteSetVisible(&heart_sprite, beat);
+                SpriteLayerRender(&heart_layer);
                 beat = !beat;
             }
         }
@@ -10,69 +10,275 @@
  */
 
 /*==================[inclusions]=============================================*/
+#include <stddef.h>
 #include "roll_plot.h"
 #include "ili9341.h"
 /*==================[macros and definitions]=================================*/
-
+#define COLUMN_WIDTH	2		/*!< Columns sent per transfer: the new one and the blank one ahead */
 /*==================[internal data declaration]==============================*/
 
 /*==================[internal functions declaration]=========================*/
+/**
+ * @brief  		Background color of a plot pixel (back color or grid)
+ * @param[in]  	plot: Structure with the plot configuration
+ * @param[in]  	x: Column of the pixel
+ * @param[in]  	y: Row of the pixel
+ * @retval 		Pixel color
+ */
+static uint16_t BackPixel(plot_t * plot, uint16_t x, uint16_t y);
+
+/**
+ * @brief  		Compose a plot column and the blank column ahead, and send them
+ * 				to the display in a single window. In hardware scroll mode only
+ * 				the column is sent, and the display is scrolled to show it last
+ * @param[in]  	plot: Structure with the plot configuration
+ * @param[in]  	signals: Signals whose envelopes are drawn in the column
+ * @param[in]  	n: Number of signals
+ * @param[in]  	x: Column to draw
+ * @retval 		None
+ */
+static void DrawColumn(plot_t * plot, signal_t ** signals, uint8_t n, uint16_t x);
+
+/**
+ * @brief  		Convert a data value of a signal to a plot row
+ * @param[in]  	signal: Structure with the signal configuration
+ * @param[in]  	data: Data value
+ * @retval 		Row, limited to the plot area
+ */
+static int16_t DataToRow(signal_t * signal, int16_t data);
+
+/**
+ * @brief  		Add a sample of each signal to the envelopes of the column being
+ * 				filled, sending the columns it completes. All the signals must
+ * 				be in the same column
+ * @param[in]  	plot: Structure with the plot configuration
+ * @param[in]  	signals: Signals to update
+ * @param[in]  	n: Number of signals
+ * @param[in]  	data: Data values, one for each signal
+ * @retval 		None
+ */
+static void AddSamples(plot_t * plot, signal_t ** signals, uint8_t n, const int16_t * data);
 
 /*==================[internal data definition]===============================*/
+static uint8_t column[COLUMN_WIDTH * RT_PLOT_MAX_HEIGHT * 2];	/*!< Composed columns, 2 bytes per pixel */
 
 /*==================[external data definition]===============================*/
 
 /*==================[internal functions definition]==========================*/
+static uint16_t BackPixel(plot_t * plot, uint16_t x, uint16_t y){
+	if (plot->grid_step && ((((x - plot->x_pos) % plot->grid_step) == 0) ||
+			(((y - plot->y_pos) % plot->grid_step) == 0))){
+		return plot->grid_color;
+	}
+	return plot->back_color;
+}
+
+static void DrawColumn(plot_t * plot, signal_t ** signals, uint8_t n, uint16_t x){
+	uint16_t y, color, width, i;
+	uint16_t top = plot->y_pos, bottom = plot->y_pos + plot->height;
+	uint16_t new_top = 0xFFFF, new_bottom = 0;
+	plot_span_t * span;
+	uint8_t k;
+
+	/* The blank column is left out at the right edge of the plot */
+	width = COLUMN_WIDTH;
+	if (plot->hw_scroll || ((x + 1) >= (plot->x_pos + plot->width))){
+		width = 1;
+	}
+	if (plot->spans != NULL){
+		/* Only the rows drawn before (in this column and in the blank one)
+		 * and the new envelopes change, the rest is already background */
+		for (k = 0; k < n; k++){
+			if (signals[k]->y_min < new_top){
+				new_top = signals[k]->y_min;
+			}
+			if (signals[k]->y_max > new_bottom){
+				new_bottom = signals[k]->y_max;
+			}
+		}
+		span = &plot->spans[x - plot->x_pos];
+		top = (span->top < new_top) ? span->top : new_top;
+		bottom = (span->bottom > new_bottom) ? span->bottom : new_bottom;
+		span->top = new_top;
+		span->bottom = new_bottom;
+		if (width == COLUMN_WIDTH){
+			span++;
+			if (span->top < top){
+				top = span->top;
+			}
+			if (span->bottom > bottom){
+				bottom = span->bottom;
+			}
+			span->top = 0xFFFF;
+			span->bottom = 0;
+		}
+	}
+	i = 0;
+	for (y = top; y <= bottom; y++){
+		color = BackPixel(plot, x, y);
+		/* later signals are drawn on top */
+		for (k = 0; k < n; k++){
+			if ((y >= signals[k]->y_min) && (y <= signals[k]->y_max)){
+				color = signals[k]->color;
+			}
+		}
+		column[i++] = color >> 8;
+		column[i++] = color & 0xFF;
+		if (width == COLUMN_WIDTH){
+			color = BackPixel(plot, x + 1, y);
+			column[i++] = color >> 8;
+			column[i++] = color & 0xFF;
+		}
+	}
+	ILI9341DrawPicture(x, top, width, bottom - top + 1, column);
+	if (plot->hw_scroll){
+		/* the column after the new one is the oldest, it goes to the left edge */
+		x++;
+		if (x >= (plot->x_pos + plot->width)){
+			x = plot->x_pos;
+		}
+		ILI9341Scroll(x);
+	}
+}
+
+static int16_t DataToRow(signal_t * signal, int16_t data){
+    plot_t * plot = signal->plot;
+    int16_t y;
+    y = plot->y_pos + plot->height - (data * signal->y_scale) / 100 - signal->y_offset;
+    /* it can exceed plot limits */
+    if (y < plot->y_pos){
+        y = plot->y_pos;
+    }
+    if (y > (plot->y_pos + plot->height)){
+        y = plot->y_pos + plot->height;
+    }
+    return y;
+}
+
+static void AddSamples(plot_t * plot, signal_t ** signals, uint8_t n, const int16_t * data){
+    int16_t x_act, x_col, x_col_prev, x, y_from, y_to;
+    int16_t y_act[RT_PLOT_MAX_SIGNALS];
+    uint8_t k;
+    signal_t * signal;
+
+    /* all signals share the same column */
+    x_act = signals[0]->x_prev + plot->x_scale;
+    x_col = x_act / 100;
+    x_col_prev = signals[0]->x_prev / 100;
+    for (k = 0; k < n; k++){
+        y_act[k] = DataToRow(signals[k], data[k]);
+    }
+    if (x_col == x_col_prev){
+        /* still in the same column: only the envelopes grow */
+        for (k = 0; k < n; k++){
+            signal = signals[k];
+            if (y_act[k] < signal->y_min){
+                signal->y_min = y_act[k];
+            }
+            if (y_act[k] > signal->y_max){
+                signal->y_max = y_act[k];
+            }
+        }
+    } else{
+        /* the column being filled is complete */
+        DrawColumn(plot, signals, n, x_col_prev);
+        if (x_col >= (plot->x_pos + plot->width)){
+            /* when reach right limit it start again from left */
+            x_act = plot->x_pos * 100;
+            for (k = 0; k < n; k++){
+                signals[k]->y_min = y_act[k];
+                signals[k]->y_max = y_act[k];
+            }
+        } else{
+            /* each column crossed gets its part of the segments, the last
+             * one is left open for the next samples */
+            for (x = x_col_prev + 1; x <= x_col; x++){
+                for (k = 0; k < n; k++){
+                    signal = signals[k];
+                    y_from = signal->y_prev + ((y_act[k] - signal->y_prev) * (x - 1 - x_col_prev)) /
+                            (x_col - x_col_prev);
+                    y_to = signal->y_prev + ((y_act[k] - signal->y_prev) * (x - x_col_prev)) /
+                            (x_col - x_col_prev);
+                    signal->y_min = (y_from < y_to) ? y_from : y_to;
+                    signal->y_max = (y_from < y_to) ? y_to : y_from;
+                }
+                if (x < x_col){
+                    DrawColumn(plot, signals, n, x);
+                }
+            }
+        }
+    }
+    /* Update last point */
+    for (k = 0; k < n; k++){
+        signals[k]->x_prev = x_act;
+        signals[k]->y_prev = y_act[k];
+    }
+}
 
 /*==================[external functions definition]==========================*/
 void RTPlotInit(plot_t * plot){
+	uint16_t i;
+
+	plot->n_signals = 0;
+	if (plot->spans != NULL){
+		for (i = 0; i < plot->width; i++){
+			plot->spans[i].top = 0xFFFF;
+			plot->spans[i].bottom = 0;
+		}
+	}
+	/* Column buffer limits the plot height */
+	if (plot->height >= RT_PLOT_MAX_HEIGHT){
+		plot->height = RT_PLOT_MAX_HEIGHT - 1;
+	}
 	ILI9341DrawFilledRectangle(plot->x_pos, plot->y_pos,
 			plot->x_pos + plot->width, plot->y_pos + plot->height,
 			plot->back_color);
-
+	if (plot->grid_step){
+		for (i = 0; i < plot->width; i += plot->grid_step){
+			ILI9341DrawLine(plot->x_pos + i, plot->y_pos, plot->x_pos + i,
+					plot->y_pos + plot->height, plot->grid_color);
+		}
+		for (i = 0; i <= plot->height; i += plot->grid_step){
+			ILI9341DrawLine(plot->x_pos, plot->y_pos + i, plot->x_pos + plot->width - 1,
+					plot->y_pos + i, plot->grid_color);
+		}
+	}
+	if (plot->hw_scroll){
+		ILI9341SetScrollArea(plot->x_pos, plot->width, ILI9341_HEIGHT - plot->x_pos - plot->width);
+		ILI9341Scroll(plot->x_pos);
+	}
 }
 
 void RTSignalInit(plot_t * plot, signal_t * signal){
 	signal->x_prev = plot->x_pos * 100;
 	signal->y_prev = plot->y_pos + plot->height - signal->y_offset;
+	signal->y_min = signal->y_prev;
+	signal->y_max = signal->y_prev;
 	signal->plot = plot;
+	if (plot->n_signals < RT_PLOT_MAX_SIGNALS){
+		plot->signals[plot->n_signals++] = signal;
+	}
 }
 
 void RTPlotDraw(signal_t * signal, int16_t data){
-    int16_t x_act, y_act, blanck_act;
-    plot_t * plot = signal->plot;
-    /* next point to draw */
-    y_act = plot->y_pos + plot->height - (data * signal->y_scale) / 100 - signal->y_offset;
-    /* it can exceed plot limits */
-    if (y_act < plot->y_pos){
-        y_act = plot->y_pos;
-    }
-    if (y_act > (plot->y_pos + plot->height)){
-        y_act = plot->y_pos + plot->height;
-    }
-    /* when reach right limit it start again from left */
-    x_act = signal->x_prev + plot->x_scale;
-    if ((x_act / 100) < (plot->x_pos + plot->width)){
-        ILI9341DrawLine(signal->x_prev / 100, signal->y_prev, x_act / 100, y_act, signal->color);
-    } else{
-        x_act = plot->x_pos * 100;
+    RTPlotDrawBlock(signal, &data, 1);
+}
+
+void RTPlotDrawBlock(signal_t * signal, const int16_t * data, uint16_t n){
+    uint16_t i;
+    for (i = 0; i < n; i++){
+        AddSamples(signal->plot, &signal, 1, &data[i]);
     }
-    /* to erase previous plot*/
-    if (plot->x_scale >= 100){
-        blanck_act = x_act + plot->x_scale;
-    } else {
-        blanck_act = x_act + 100;
+}
+
+void RTPlotDrawTraces(plot_t * plot, const int16_t * data, uint16_t n){
+    uint16_t i;
+    if (plot->n_signals == 0){
+        return;
     }
-    if ((blanck_act / 100) < (plot->x_pos + plot->width)){
-        ILI9341DrawFilledRectangle((x_act / 100) + 1, plot->y_pos, blanck_act / 100,
-        plot->y_pos + plot->height, plot->back_color);
-    } else{
-        ILI9341DrawFilledRectangle(plot->x_pos, plot->y_pos, plot->x_pos,
-        plot->y_pos + plot->height, plot->back_color);
+    for (i = 0; i < n; i++){
+        AddSamples(plot, plot->signals, plot->n_signals, &data[i * plot->n_signals]);
     }
-    /* Update previously drawn point */
-    signal->x_prev = x_act;
-    signal->y_prev = y_act;
 }
 
 /*==================[end of file]============================================*/
@@ -18,14 +18,32 @@
  * |   Date	    | Description                                    						|
  * |:----------:|:----------------------------------------------------------------------|
  * | 04/04/2024 | Document creation		                         						|
+ * | 19/10/2026 | Column renderer: one window transfer per plot column					|
+ * | 19/10/2026 | Sample blocks drawn as a min/max envelope per column					|
+ * | 19/10/2026 | Hardware scrolling mode													|
+ * | 19/10/2026 | Several traces composed in the same column transfer					|
+ * | 19/10/2026 | Only the rows changed in a column are sent (optional span table)		|
  * 
  **/
 
 /*==================[inclusions]=============================================*/
 #include <stdint.h>
+#include <stdbool.h>
 /*==================[macros]=================================================*/
+#define RT_PLOT_MAX_HEIGHT	320		/*!< Maximum plot height (long side of the display) */
+#define RT_PLOT_MAX_SIGNALS	4		/*!< Maximum number of signals registered in a plot */
 
 /*==================[typedef]================================================*/
+typedef struct signal_s signal_t;
+
+/**
+ * @brief Rows drawn over the background in a plot column (empty if top > bottom)
+ */
+typedef struct{
+	uint16_t top;		/*!< first row drawn */
+	uint16_t bottom;	/*!< last row drawn */
+} plot_span_t;
+
 /**
  * @brief 
  * 
@@ -37,20 +55,28 @@ typedef struct{
     uint16_t height; 	/*!< plot height */
     uint16_t x_scale;	/*!< x scale in % (number of pixels drawn per 100 data samples) */
     uint16_t back_color;/*!< plot background color */
+    uint16_t grid_color;/*!< grid color */
+    uint16_t grid_step;	/*!< grid spacing in pixels (0: no grid) */
+    bool hw_scroll;		/*!< scroll the plot with the LCD hardware scrolling (see RTPlotInit) */
+    signal_t * signals[RT_PLOT_MAX_SIGNALS];	/*!< signals registered by RTSignalInit */
+    uint8_t n_signals;	/*!< number of signals registered */
+    plot_span_t * spans;/*!< table of width entries, or NULL: with it only the changed rows of a column are sent */
 } plot_t;
 
 /**
  * @brief 
  * 
  */
-typedef struct{
+struct signal_s{
 	uint16_t y_scale;	/*!< y scale in % (number of pixels drawn per 100 data value) */
     uint16_t y_offset; 	/*!< y offset */
 	uint16_t color;		/*!< plot color */
 	uint16_t x_prev;	/*!< x position of last point drawn */
 	uint16_t y_prev;	/*!< y position of last point drawn */
+	uint16_t y_min;		/*!< top of the envelope of the column being filled */
+	uint16_t y_max;		/*!< bottom of the envelope of the column being filled */
 	plot_t * plot;		/*!< plot in which the signal'll be drawn */
-} signal_t;
+};
 
 /*==================[external data declaration]==============================*/
 
@@ -60,6 +86,16 @@ typedef struct{
  * @brief  		Initializes a plot
  * @param[in]  	plot: Structure with the plot configuration
  * @retval 		NONE
+ * @note		With hw_scroll the LCD must be in ILI9341_Landscape_1 orientation.
+ * 				New columns are written in place and the display scrolls so the
+ * 				newest one is always at the right edge, without a blank column.
+ * 				Hardware scrolling moves whole LCD columns, so anything else drawn
+ * 				in the columns of the plot scrolls with it: the plot should use the
+ * 				full LCD height. Only one hw_scroll plot can be used at a time.
+ * @note		With a spans table a new column is sent from the top of what it
+ * 				replaces (or of its envelopes, if higher) to the bottom of either,
+ * 				instead of the full plot height. The rest of the column already
+ * 				shows the background. Nothing else should be drawn over the plot.
  */
 void RTPlotInit(plot_t * plot);
 
@@ -68,19 +104,49 @@ void RTPlotInit(plot_t * plot);
  * @param[in]  	plot: Structure with the plot configuration
  * @param[in]  	signal: Structure with the signal configuration
  * @retval 		NONE
+ * @note		The signal is also registered in the plot (up to RT_PLOT_MAX_SIGNALS,
+ * 				after RTPlotInit), to be drawn by RTPlotDrawTraces.
  */
 void RTSignalInit(plot_t * plot, signal_t * signal);
 
 /**
- * @brief		Write data to SPI port
- * @param[in]	plot: Structure with the plot configuration
+ * @brief		Draw a new sample of a signal
  * @param[in]  	signal: Structure with the signal configuration
  * @param[in]	data: Data value to draw in plot
  * @return  	None
- * @note
+ * @note		Same as RTPlotDrawBlock() with a block of one sample.
  */
 void RTPlotDraw(signal_t * signal, int16_t data);
 
+/**
+ * @brief		Draw a block of consecutive samples of a signal
+ * @param[in]  	signal: Structure with the signal configuration
+ * @param[in]	data: Data values to draw in plot
+ * @param[in]	n: Number of samples in data
+ * @return  	None
+ * @note		Samples falling in the same pixel column are drawn as a vertical
+ * 				min/max envelope, joined to the last sample of the previous column.
+ * 				A column is sent to the display (with the blank column ahead of it)
+ * 				only once it is complete, so the display is written at a fixed
+ * 				pixel rate whatever the sample rate is. The column being filled
+ * 				is shown when the next sample crosses into a new column.
+ */
+void RTPlotDrawBlock(signal_t * signal, const int16_t * data, uint16_t n);
+
+/**
+ * @brief		Draw a block of samples of all the signals registered in a plot
+ * @param[in]  	plot: Structure with the plot configuration
+ * @param[in]	data: Data values, one frame per sample time with one value for
+ * 				each signal, in the order the signals were initialized
+ * @param[in]	n: Number of frames in data
+ * @return  	None
+ * @note		Works like RTPlotDrawBlock, but the envelopes of all the traces
+ * 				are composed in the same column buffer and sent in a single
+ * 				transfer, so several traces cost about the same as one. Traces
+ * 				initialized later are drawn on top.
+ */
+void RTPlotDrawTraces(plot_t * plot, const int16_t * data, uint16_t n);
+
 #endif /* ROLL_PLOT_H_ */
 
 /*==================[end of file]============================================*/
@@ -23,6 +23,7 @@
  * |   Date	    | Description                                    |
  * |:----------:|:-----------------------------------------------|
  * | 12/04/2024 | Document creation		                         |
+ * | 19/10/2026 | Medicion con el planificador del HC-SR04       |
  *
  * @author Joaquin Palacio
  *
@@ -48,6 +49,12 @@
 */
 #define CONFIG_SENSOR_TIMER_A 1000000
 
+/**
+ * @def CONFIG_SENSOR_SLOT
+ * @brief Periodo de medicion del sensor hc-sr04 en us
+*/
+#define CONFIG_SENSOR_SLOT 50000
+
 /** @def BASE
  * @brief base numérica del número que se va a convertir a ASCII
 */
@@ -187,7 +194,7 @@ static void CalcDist(void *pvParameter){
 		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);    /* La tarea espera en este punto hasta recibir una notificación */
 		if(on == 1)
 		{
-			distancia = HcSr04ReadDistanceInCentimeters();
+			HcSr04SchedulerGetDistancesInCentimeters(&distancia);	/* Ultima medicion, sin esperar el eco */
 		}
 		else
 		{
@@ -273,7 +280,19 @@ static void LecturaSwitch2(){
 /*==================[external functions definition]==========================*/
 void app_main(void){
 	LedsInit();
-	HcSr04Init(3, 2);
+	hc_sr04_sensor_t sensor = {
+		.echo = GPIO_3,
+		.trigger = GPIO_2,
+		.slot = 0
+	};
+	hc_sr04_scheduler_t scheduler = {
+		.sensors = &sensor,
+		.n_sensors = 1,
+		.slot_us = CONFIG_SENSOR_SLOT,
+		.func_p = NULL,
+		.param_p = NULL
+	};
+	HcSr04SchedulerStart(&scheduler);
 	LcdItsE0803Init();
 	SwitchesInit();
 
@@ -0,0 +1,189 @@
+/*! @mainpage ILI9341 benchmark
+ *
+ * @section genDesc General Description
+ *
+ * Runs every drawing primitive of the ILI9341 driver at standard sizes and
+ * reports, for each one, the number of SPI transactions, the bytes sent on the
+ * bus and the wall time measured on target. It also prints the time predicted
+ * by a simple cost model:
+ *
+ * 		time = transactions * T_TRANSACTION + bytes * 8 / SPI_BITRATE
+ *
+ * where T_TRANSACTION (fixed cost of a transaction: DC toggle, driver setup,
+ * CS) is calibrated with a batch of single pixels. A primitive that is slower
+ * than the model is spending time in the CPU, not on the bus.
+ *
+ * The last columns show how many transactions were done by polling, by
+ * interrupt and queued. The ILI9341 driver queues all its writes, so only
+ * the queue column counts for the display.
+ *
+ * Run it before and after a change in the display drivers and compare the
+ * output on the serial monitor.
+ *
+ * @section hardConn Hardware Connection
+ *
+ * |    Display     |   ESP32   	|
+ * |:--------------:|:--------------|
+ * | 	SDO/MISO 	|	GPIO_22		|
+ * | 	SCK		 	| 	GPIO_20		|
+ * | 	SDI/MOSI 	| 	GPIO_21		|
+ * | 	DC/RS	 	| 	GPIO_9		|
+ * | 	RESET	 	| 	GPIO_18		|
+ * | 	CS		 	| 	GPIO_19		|
+ * | 	LED		 	| 	3V3			|
+ * | 	VCC		 	| 	3V3			|
+ * | 	GND		 	| 	GND			|
+ *
+ *
+ * @section changelog Changelog
+ *
+ * |   Date	    | Description                                    |
+ * |:----------:|:-----------------------------------------------|
+ * | 19/10/2026 | Document creation		                         |
+ *
+ * @author Joaquin Palacio
+ *
+ */
+
+/*==================[inclusions]=============================================*/
+#include <stdio.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "ili9341.h"
+#include "fonts.h"
+#include "spi_mcu.h"
+#include "gpio_mcu.h"
+/*==================[macros and definitions]=================================*/
+#define LCD_SPI			SPI_1
+#define SPI_BITRATE		20000000	/*!< Same bitrate used by the ILI9341 driver */
+#define CALIB_PIXELS	200			/*!< Pixels drawn to calibrate the transaction cost */
+#define PIC_WIDTH		52
+#define PIC_HEIGHT		45
+#define BENCH_DELAY_MS	200			/*!< Pause between primitives, to see them on the LCD */
+
+/** Runs a drawing statement as a benchmark */
+#define BENCH(name, statement) do {			\
+		bench_result_t result;				\
+		BenchStart();						\
+		statement;							\
+		BenchEnd(&result);					\
+		BenchPrint(name, &result);			\
+	} while (0)
+
+/**
+ * @brief Result of a benchmark
+ */
+typedef struct {
+	uint32_t time_us;		/*!< Wall time */
+	spi_stats_t stats;		/*!< SPI traffic */
+} bench_result_t;
+
+/*==================[internal data definition]===============================*/
+static uint8_t picture[PIC_WIDTH * PIC_HEIGHT * 2];		/*!< Raw RGB565 test picture */
+static uint8_t picture_rle[PIC_HEIGHT * 6];				/*!< Same size picture in RLE format */
+static float t_transaction_us;							/*!< Calibrated fixed cost of a transaction */
+static int64_t t_start;									/*!< Start time of the running benchmark */
+
+/*==================[internal functions declaration]=========================*/
+static void BenchStart(void);
+static void BenchEnd(bench_result_t *result);
+static void BenchPrint(const char *name, bench_result_t *result);
+static void MakePictures(void);
+static void Calibrate(void);
+
+/*==================[internal functions definition]==========================*/
+static void BenchStart(void){
+	SpiResetStats(LCD_SPI);
+	t_start = esp_timer_get_time();
+}
+
+static void BenchEnd(bench_result_t *result){
+	/* Drawing functions return with the last transfers still queued */
+	ILI9341Wait();
+	result->time_us = esp_timer_get_time() - t_start;
+	SpiGetStats(LCD_SPI, &result->stats);
+}
+
+static void BenchPrint(const char *name, bench_result_t *result){
+	float wire_us = result->stats.bytes * 8.0 * 1000000.0 / SPI_BITRATE;
+	float model_us = result->stats.transactions * t_transaction_us + wire_us;
+	printf("%-22s %8lu %8lu %10lu %10.0f %10.0f %6lu %6lu %6lu\r\n", name,
+			(unsigned long)result->stats.transactions, (unsigned long)result->stats.bytes,
+			(unsigned long)result->time_us, wire_us, model_us, (unsigned long)result->stats.polling,
+			(unsigned long)result->stats.interrupt, (unsigned long)result->stats.queued);
+	vTaskDelay(BENCH_DELAY_MS / portTICK_PERIOD_MS);
+}
+
+static void MakePictures(void){
+	uint16_t x, y, color, i = 0;
+
+	for (y = 0; y < PIC_HEIGHT; y++){
+		for (x = 0; x < PIC_WIDTH; x++){
+			color = ((x * 31 / PIC_WIDTH) << 11) | ((y * 63 / PIC_HEIGHT) << 5);
+			picture[i++] = color >> 8;
+			picture[i++] = color & 0xFF;
+		}
+	}
+	/* Two runs per row */
+	i = 0;
+	for (y = 0; y < PIC_HEIGHT; y++){
+		picture_rle[i++] = 0x80 | (PIC_WIDTH / 2 - 1);
+		picture_rle[i++] = ILI9341_RED >> 8;
+		picture_rle[i++] = ILI9341_RED & 0xFF;
+		picture_rle[i++] = 0x80 | (PIC_WIDTH / 2 - 1);
+		picture_rle[i++] = ILI9341_WHITE >> 8;
+		picture_rle[i++] = ILI9341_WHITE & 0xFF;
+	}
+}
+
+static void Calibrate(void){
+	bench_result_t result;
+	uint16_t i;
+	float wire_us;
+
+	BenchStart();
+	for (i = 0; i < CALIB_PIXELS; i++){
+		ILI9341DrawPixel(i, 0, ILI9341_BLACK);
+	}
+	BenchEnd(&result);
+	wire_us = result.stats.bytes * 8.0 * 1000000.0 / SPI_BITRATE;
+	t_transaction_us = (result.time_us - wire_us) / result.stats.transactions;
+	printf("T_TRANSACTION = %.2f us (%lu transactions, %lu bytes, %lu us)\r\n\r\n",
+			t_transaction_us, (unsigned long)result.stats.transactions,
+			(unsigned long)result.stats.bytes, (unsigned long)result.time_us);
+}
+
+/*==================[external functions definition]==========================*/
+void app_main(void){
+	ILI9341Init(LCD_SPI, GPIO_9, GPIO_18);
+	ILI9341Rotate(ILI9341_Portrait_1);
+	MakePictures();
+
+	while (1){
+		ILI9341Fill(ILI9341_WHITE);
+		Calibrate();
+		printf("%-22s %8s %8s %10s %10s %10s %6s %6s %6s\r\n", "primitive", "trans", "bytes",
+				"time_us", "wire_us", "model_us", "poll", "intr", "queue");
+		BENCH("Fill", ILI9341Fill(ILI9341_NAVY));
+		BENCH("DrawFilledRect 50x50", ILI9341DrawFilledRectangle(10, 10, 59, 59, ILI9341_YELLOW));
+		BENCH("DrawChar 11x18", ILI9341DrawChar(10, 80, 'A', &font_11x18, ILI9341_BLACK, ILI9341_WHITE));
+		BENCH("DrawString 10x 11x18", ILI9341DrawString(10, 100, "0123456789", &font_11x18, ILI9341_BLACK, ILI9341_WHITE));
+		BENCH("DrawInt 3 dig 16x26", ILI9341DrawInt(10, 120, 123, 3, &font_16x26, ILI9341_BLACK, ILI9341_WHITE));
+		BENCH("DrawLine horiz 200", ILI9341DrawLine(20, 160, 219, 160, ILI9341_RED));
+		BENCH("DrawLine vert 200", ILI9341DrawLine(20, 100, 20, 299, ILI9341_RED));
+		BENCH("DrawLine shallow", ILI9341DrawLine(20, 170, 219, 200, ILI9341_RED));
+		BENCH("DrawLine diagonal", ILI9341DrawLine(20, 100, 219, 299, ILI9341_RED));
+		BENCH("DrawRectangle 100x100", ILI9341DrawRectangle(70, 110, 169, 209, ILI9341_BLUE));
+		BENCH("DrawCircle r50", ILI9341DrawCircle(120, 160, 50, ILI9341_GREEN));
+		BENCH("DrawFilledCircle r50", ILI9341DrawFilledCircle(120, 160, 50, ILI9341_GREEN));
+		BENCH("DrawTriangle", ILI9341DrawTriangle(20, 300, 120, 200, 220, 300, ILI9341_MAGENTA));
+		BENCH("DrawFilledTriangle", ILI9341DrawFilledTriangle(20, 300, 120, 200, 220, 300, ILI9341_MAGENTA));
+		BENCH("DrawPicture 52x45", ILI9341DrawPicture(180, 10, PIC_WIDTH, PIC_HEIGHT, picture));
+		BENCH("DrawRlePicture 52x45", ILI9341DrawRlePicture(180, 60, PIC_WIDTH, PIC_HEIGHT, picture_rle));
+		printf("\r\n");
+		vTaskDelay(5000 / portTICK_PERIOD_MS);
+	}
+}
+/*==================[end of file]============================================*/
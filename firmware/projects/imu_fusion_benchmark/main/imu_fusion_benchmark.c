@@ -0,0 +1,116 @@
+/*! @mainpage IMU fusion benchmark
+ *
+ * @section genDesc General Description
+ *
+ * Acquires accelerometer and gyroscope data from the MPU6050 at 1 kHz
+ * (interrupt driven FIFO acquisition, batches of BATCH samples) and runs the
+ * fixed point orientation filter (imu_fusion.h) on every sample. Once per
+ * second it prints the Euler angles, the CPU cycles per filter update and the
+ * acquisition statistics on the serial monitor.
+ *
+ * The same filter is checked against a floating point implementation and
+ * measured on the host with firmware/tools/imu_fusion_bench.c.
+ *
+ * @section hardConn Hardware Connection
+ *
+ * |    MPU6050     |   ESP32   	|
+ * |:--------------:|:--------------|
+ * | 	SDA		 	|	GPIO_6		|
+ * | 	SCL		 	| 	GPIO_7		|
+ * | 	INT		 	| 	GPIO_3		|
+ * | 	VCC		 	| 	3V3			|
+ * | 	GND		 	| 	GND			|
+ *
+ *
+ * @section changelog Changelog
+ *
+ * |   Date	    | Description                                    |
+ * |:----------:|:-----------------------------------------------|
+ * | 19/10/2026 | Document creation		                         |
+ *
+ * @author Joaquin Palacio
+ *
+ */
+
+/*==================[inclusions]=============================================*/
+#include <stdio.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_cpu.h"
+#include "i2c_mcu.h"
+#include "mpu6050.h"
+#include "imu_fusion.h"
+#include "gpio_mcu.h"
+/*==================[macros and definitions]=================================*/
+#define I2C_CLOCK_HZ	400000
+#define SAMPLE_RATE_HZ	1000
+#define BATCH			10			/*!< Samples per wakeup of the acquisition task */
+#define MPU_INT_PIN		GPIO_3
+#define ACQ_PRIORITY	5			/*!< Priority of the acquisition task */
+#define REPORT_MS		1000
+
+/*==================[internal data definition]===============================*/
+static imu_fusion_t fusion;							/*!< Filter state */
+static mpu6050_sample_t samples[MPU6050_FIFO_BATCH];	/*!< Samples of the current batch */
+static volatile uint32_t cycles;					/*!< CPU cycles spent in the filter */
+static volatile uint32_t updates;					/*!< Filter updates measured in cycles */
+
+/*==================[internal functions declaration]=========================*/
+static void ProcessSamples(void *param);
+
+/*==================[internal functions definition]==========================*/
+/**
+ * @brief Runs the filter on the new samples, from the acquisition task
+ */
+static void ProcessSamples(void *param){
+	uint16_t n = 0;
+	uint32_t start;
+
+	while ((n < MPU6050_FIFO_BATCH) && MPU6050_fifoGetSample(&samples[n])){
+		n++;
+	}
+	if (n == 0){
+		return;
+	}
+	start = esp_cpu_get_cycle_count();
+	ImuFusionUpdateBatch(&fusion, &samples[0].ax, n, sizeof(mpu6050_sample_t));
+	cycles += esp_cpu_get_cycle_count() - start;
+	updates += n;
+}
+
+/*==================[external functions definition]==========================*/
+void app_main(void){
+	mpu6050_fifo_stats_t stats;
+	imu_euler_t euler;
+	uint32_t c, u;
+	uint16_t rate;
+
+	I2C_initialize(I2C_CLOCK_HZ);
+	MPU6050_initialize();
+	ImuFusionInit(&fusion, SAMPLE_RATE_HZ, MPU6050_getFullScaleGyroRange(), IMU_FUSION_KP, IMU_FUSION_KI);
+	rate = MPU6050_intStart(MPU_INT_PIN, SAMPLE_RATE_HZ, MPU6050_DLPF_BW_188, BATCH, ProcessSamples, NULL, ACQ_PRIORITY);
+	if (rate != SAMPLE_RATE_HZ){
+		printf("MPU6050 acquisition failed (%u Hz)\r\n", rate);
+		return;
+	}
+	printf("%8s %8s %8s %8s %10s %8s %8s\r\n", "roll", "pitch", "yaw", "updates", "cyc/upd",
+			"lat_max", "ovf");
+	while (1){
+		vTaskDelay(REPORT_MS / portTICK_PERIOD_MS);
+		/* Copy and clear together, the acquisition task has a higher priority */
+		vTaskSuspendAll();
+		c = cycles;
+		u = updates;
+		cycles = 0;
+		updates = 0;
+		xTaskResumeAll();
+		ImuFusionGetEuler(&fusion, &euler);
+		MPU6050_fifoGetStats(&stats);
+		printf("%8.2f %8.2f %8.2f %8lu %10lu %8lu %8lu\r\n", euler.roll / 100.0, euler.pitch / 100.0,
+				euler.yaw / 100.0, (unsigned long)u, (unsigned long)(u ? c / u : 0),
+				(unsigned long)stats.latency_max_us, (unsigned long)stats.overflows);
+	}
+}
+
+/*==================[end of file]============================================*/
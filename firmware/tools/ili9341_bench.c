@@ -0,0 +1,453 @@
+/**
+ * @file ili9341_bench.c
+ * @brief Host cost model of the ILI9341 drawing primitives
+ *
+ * Links the ILI9341 driver against a mock of spi_mcu (and of the GPIO and
+ * delay drivers) that counts the transactions and bytes sent to the display,
+ * and runs the primitives of projects/ili9341_benchmark with the same sizes.
+ * The table has the same columns as the one printed on target, time_us being
+ * the host CPU time of the call:
+ *
+ * 		model_us = transactions * T_TRANSACTION + bytes * 8 / SPI_BITRATE
+ *
+ * T_TRANSACTION is the value calibrated on target by projects/ili9341_benchmark
+ * (first line of its output), passed as argument (0 if not given: wire time
+ * only). Transaction and byte counts are exact, so a change in a primitive can
+ * be checked here before running it on the display.
+ *
+ * The outline and filled shapes, drawn as spans by the driver, are also drawn
+ * with the pixel by pixel algorithms they replaced. The mock decodes the
+ * frame memory writes, so both versions are compared pixel by pixel, and
+ * the transactions and bytes of each are shown side by side. The exit status
+ * is not zero if any shape differs. The filled triangle is not compared: its
+ * integer scanline rounds the edges differently than the float one it replaced.
+ *
+ * The rolling plot of projects/ProyectoFinal is measured too: a full sweep
+ * with three traces, as the project draws it, and in hardware scroll mode.
+ * Each one is run again with a spans table (only the changed rows of a column
+ * are sent), and its frame memory is checked against the full column one.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -Ifirmware/drivers/devices/inc -Ifirmware/drivers/microcontroller/inc \
+ *       -Ifirmware/projects/ProyectoFinal/main firmware/tools/ili9341_bench.c \
+ *       firmware/drivers/devices/src/ili9341.c firmware/drivers/devices/src/fonts.c \
+ *       firmware/projects/ProyectoFinal/main/roll_plot.c -lm -o ili9341_bench
+ *   ./ili9341_bench [T_TRANSACTION_us]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ili9341.h"
+#include "fonts.h"
+#include "spi_mcu.h"
+#include "gpio_mcu.h"
+#include "delay_mcu.h"
+#include "roll_plot.h"
+
+#define LCD_SPI			SPI_1
+#define SPI_BITRATE		20000000	/* Same bitrate used by the ILI9341 driver */
+#define PIC_WIDTH		52
+#define PIC_HEIGHT		45
+#define FRAME_SIZE		320			/* Frame memory decoded by the mock, both orientations */
+#define CMD_COLUMN		0x2A		/* Commands decoded by the mock */
+#define CMD_PAGE		0x2B
+#define CMD_MEM_WRITE	0x2C
+#define PLOT_SAMPLES	632			/* One sweep of the ProyectoFinal plot (240 columns at x_scale 38) */
+
+/** Runs a drawing statement as a benchmark */
+#define BENCH(name, statement) do {			\
+		bench_result_t result;				\
+		BenchStart();						\
+		statement;							\
+		BenchEnd(&result);					\
+		BenchPrint(name, &result);			\
+	} while (0)
+
+typedef struct {
+	uint32_t time_us;		/* Host CPU time */
+	spi_stats_t stats;		/* SPI traffic */
+} bench_result_t;
+
+static spi_stats_t mock_stats[SPI_3 + 1];
+static uint16_t frame[FRAME_SIZE][FRAME_SIZE];	/* Frame memory, [row][column] */
+static uint8_t mock_cmd;						/* Last command */
+static uint8_t mock_args[4];					/* Address parameters of the last command */
+static uint8_t mock_nargs;
+static uint16_t win_x0, win_x1, win_y0, win_y1;	/* Memory write window */
+static uint16_t cur_x, cur_y;					/* Next pixel written */
+static int16_t high_byte;						/* First byte of a pixel, -1 if none */
+static uint8_t picture[PIC_WIDTH * PIC_HEIGHT * 2];
+static uint8_t picture_rle[PIC_HEIGHT * 6];
+static double t_transaction_us;
+static struct timespec t_start;
+
+/* Frame memory writes: address window and pixel stream */
+static void MockData(uint8_t byte){
+	switch (mock_cmd){
+		case CMD_COLUMN:
+		case CMD_PAGE:
+			if (mock_nargs < 4){
+				mock_args[mock_nargs++] = byte;
+			}
+			if (mock_nargs == 4){
+				uint16_t start = (mock_args[0] << 8) | mock_args[1], end = (mock_args[2] << 8) | mock_args[3];
+				if (mock_cmd == CMD_COLUMN){
+					win_x0 = start;
+					win_x1 = end;
+				} else{
+					win_y0 = start;
+					win_y1 = end;
+				}
+			}
+			break;
+		case CMD_MEM_WRITE:
+			if (high_byte < 0){
+				high_byte = byte;
+				break;
+			}
+			if (cur_y < FRAME_SIZE && cur_x < FRAME_SIZE){
+				frame[cur_y][cur_x] = (high_byte << 8) | byte;
+			}
+			high_byte = -1;
+			if (++cur_x > win_x1){
+				cur_x = win_x0;
+				cur_y++;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+static void MockCommand(uint8_t cmd){
+	mock_cmd = cmd;
+	mock_nargs = 0;
+	if (cmd == CMD_MEM_WRITE){
+		cur_x = win_x0;
+		cur_y = win_y0;
+		high_byte = -1;
+	}
+}
+
+/* Mock of the drivers used by ili9341.c: every transaction is counted as queued,
+ * the only kind the driver does */
+uint8_t SpiInit(spi_mcu_config_t *spi){
+	return 0;
+}
+
+bool SpiQueueWriteDC(spi_dev_t device, bool dc, uint8_t *tx_buffer, uint32_t tx_buffer_size, void *func_p, void *param_p){
+	mock_stats[device].transactions++;
+	mock_stats[device].queued++;
+	mock_stats[device].bytes += tx_buffer_size;
+	for (uint32_t i = 0; i < tx_buffer_size; i++){
+		if (dc){
+			MockData(tx_buffer[i]);
+		} else{
+			MockCommand(tx_buffer[i]);
+		}
+	}
+	return true;
+}
+
+void SpiWaitAll(spi_dev_t device){
+}
+
+void SpiGetStats(spi_dev_t device, spi_stats_t *stats){
+	*stats = mock_stats[device];
+}
+
+void SpiResetStats(spi_dev_t device){
+	memset(&mock_stats[device], 0, sizeof(spi_stats_t));
+}
+
+void GPIOInit(gpio_t pin, io_t io){
+}
+
+void GPIOOn(gpio_t pin){
+}
+
+void DelayMs(uint16_t msec){
+}
+
+void DelayUs(uint16_t usec){
+}
+
+/* Pixel by pixel algorithms the span versions replaced. The line already has
+ * the end point fix of the span version (both coordinates must reach it), the
+ * old loop cut shallow and steep lines short */
+void Fill(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t color);
+
+static void RefDrawLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t color){
+	int16_t x_dist = x1 - x0, y_dist = y1 - y0, x_grow = 1, y_grow = 1, error, error_2;
+
+	if (x0 > x1){
+		x_dist = -x_dist;
+		x_grow = -1;
+	}
+	if (y0 > y1){
+		y_dist = -y_dist;
+		y_grow = -1;
+	}
+	if (x_dist == 0 || y_dist == 0){
+		Fill(x0, y0, x1, y1, color);
+		return;
+	}
+	error = (x_dist >= y_dist) ? x_dist / 2 : -y_dist / 2;
+	while (1){
+		ILI9341DrawPixel(x0, y0, color);
+		if (x0 == x1 && y0 == y1){
+			break;
+		}
+		error_2 = error;
+		if (error_2 > -x_dist){
+			error -= y_dist;
+			x0 += x_grow;
+		}
+		if (error_2 < y_dist){
+			error += x_dist;
+			y0 += y_grow;
+		}
+	}
+}
+
+static void RefDrawRectangle(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t color){
+	RefDrawLine(x0, y0, x1, y0, color);
+	RefDrawLine(x1, y0, x1, y1, color);
+	RefDrawLine(x0, y1, x1, y1, color);
+	RefDrawLine(x0, y0, x0, y1, color);
+}
+
+static void RefDrawCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color, bool filled){
+	int16_t f = 1 - r, ddF_x = 1, ddF_y = -2 * r, x = 0, y = r;
+
+	ILI9341DrawPixel(x0, y0 + r, color);
+	ILI9341DrawPixel(x0, y0 - r, color);
+	ILI9341DrawPixel(x0 + r, y0, color);
+	ILI9341DrawPixel(x0 - r, y0, color);
+	if (filled){
+		RefDrawLine(x0 - r, y0, x0 + r, y0, color);
+	}
+	while (x < y){
+		if (f >= 0){
+			y--;
+			ddF_y += 2;
+			f += ddF_y;
+		}
+		x++;
+		ddF_x += 2;
+		f += ddF_x;
+		if (filled){
+			RefDrawLine(x0 - x, y0 + y, x0 + x, y0 + y, color);
+			RefDrawLine(x0 + x, y0 - y, x0 - x, y0 - y, color);
+			RefDrawLine(x0 + y, y0 + x, x0 - y, y0 + x, color);
+			RefDrawLine(x0 + y, y0 - x, x0 - y, y0 - x, color);
+		} else{
+			ILI9341DrawPixel(x0 + x, y0 + y, color);
+			ILI9341DrawPixel(x0 - x, y0 + y, color);
+			ILI9341DrawPixel(x0 + x, y0 - y, color);
+			ILI9341DrawPixel(x0 - x, y0 - y, color);
+			ILI9341DrawPixel(x0 + y, y0 + x, color);
+			ILI9341DrawPixel(x0 - y, y0 + x, color);
+			ILI9341DrawPixel(x0 + y, y0 - x, color);
+			ILI9341DrawPixel(x0 - y, y0 - x, color);
+		}
+	}
+}
+
+static void RefDrawTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color){
+	RefDrawLine(x0, y0, x1, y1, color);
+	RefDrawLine(x0, y0, x2, y2, color);
+	RefDrawLine(x1, y1, x2, y2, color);
+}
+
+/* Runs the reference and the driver version of a shape on a clear frame memory
+ * and prints the traffic of each one and the pixels that differ */
+#define COMPARE(name, reference, statement) do {						static uint16_t ref_frame[FRAME_SIZE][FRAME_SIZE];			spi_stats_t ref_stats, stats;								memset(frame, 0, sizeof(frame));							SpiResetStats(LCD_SPI);										reference;													SpiGetStats(LCD_SPI, &ref_stats);							memcpy(ref_frame, frame, sizeof(frame));					memset(frame, 0, sizeof(frame));							SpiResetStats(LCD_SPI);										statement;													SpiGetStats(LCD_SPI, &stats);								ComparePrint(name, &ref_stats, &stats, ref_frame);		} while (0)
+
+static unsigned compare_failed;
+
+static void ComparePrint(const char *name, spi_stats_t *ref_stats, spi_stats_t *stats, uint16_t ref_frame[FRAME_SIZE][FRAME_SIZE]){
+	unsigned diff = 0, drawn = 0;
+
+	for (int y = 0; y < FRAME_SIZE; y++){
+		for (int x = 0; x < FRAME_SIZE; x++){
+			diff += (frame[y][x] != ref_frame[y][x]);
+			drawn += (frame[y][x] != 0);
+		}
+	}
+	printf("%-22s %10lu %10lu %8lu %8lu %8u %8u\n", name, (unsigned long)ref_stats->transactions,
+			(unsigned long)ref_stats->bytes, (unsigned long)stats->transactions, (unsigned long)stats->bytes,
+			drawn, diff);
+	if (diff != 0){
+		compare_failed++;
+	}
+}
+
+static void BenchStart(void){
+	SpiResetStats(LCD_SPI);
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+}
+
+static void BenchEnd(bench_result_t *result){
+	struct timespec t_end;
+
+	ILI9341Wait();
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	result->time_us = (t_end.tv_sec - t_start.tv_sec) * 1000000 + (t_end.tv_nsec - t_start.tv_nsec) / 1000;
+	SpiGetStats(LCD_SPI, &result->stats);
+}
+
+static void BenchPrint(const char *name, bench_result_t *result){
+	double wire_us = result->stats.bytes * 8.0 * 1000000.0 / SPI_BITRATE;
+	double model_us = result->stats.transactions * t_transaction_us + wire_us;
+	printf("%-22s %8lu %8lu %10lu %10.0f %10.0f %6lu %6lu %6lu\n", name,
+			(unsigned long)result->stats.transactions, (unsigned long)result->stats.bytes,
+			(unsigned long)result->time_us, wire_us, model_us, (unsigned long)result->stats.polling,
+			(unsigned long)result->stats.interrupt, (unsigned long)result->stats.queued);
+}
+
+static void MakePictures(void){
+	uint16_t x, y, color, i = 0;
+
+	for (y = 0; y < PIC_HEIGHT; y++){
+		for (x = 0; x < PIC_WIDTH; x++){
+			color = ((x * 31 / PIC_WIDTH) << 11) | ((y * 63 / PIC_HEIGHT) << 5);
+			picture[i++] = color >> 8;
+			picture[i++] = color & 0xFF;
+		}
+	}
+	i = 0;
+	for (y = 0; y < PIC_HEIGHT; y++){
+		picture_rle[i++] = 0x80 | (PIC_WIDTH / 2 - 1);
+		picture_rle[i++] = ILI9341_RED >> 8;
+		picture_rle[i++] = ILI9341_RED & 0xFF;
+		picture_rle[i++] = 0x80 | (PIC_WIDTH / 2 - 1);
+		picture_rle[i++] = ILI9341_WHITE >> 8;
+		picture_rle[i++] = ILI9341_WHITE & 0xFF;
+	}
+}
+
+/* PPG like traces: raw, filtered and threshold, as ProyectoFinal plots them */
+static void MakeTraces(int16_t *data, uint16_t n){
+	for (uint16_t i = 0; i < n; i++){
+		double t = i / 50.0;
+		double ppg = 100 + 80 * exp(-fmod(t, 0.8) * 6) * sin(fmod(t, 0.8) * 8);
+		data[3 * i] = (int16_t)(ppg + 6 * sin(i * 1.7));
+		data[3 * i + 1] = (int16_t)ppg;
+		data[3 * i + 2] = 120;
+	}
+}
+
+static void PlotSweep(plot_t *plot, const int16_t *data){
+	signal_t signals[3] = {
+		{.y_scale = 40, .y_offset = 50, .color = ILI9341_LIGHTGREY},
+		{.y_scale = 40, .y_offset = 50, .color = ILI9341_RED},
+		{.y_scale = 40, .y_offset = 50, .color = ILI9341_BLUE}};
+
+	RTPlotInit(plot);
+	for (uint8_t k = 0; k < 3; k++){
+		RTSignalInit(plot, &signals[k]);
+	}
+	/* Second sweep: the columns already hold the traces of the first one */
+	RTPlotDrawTraces(plot, data, PLOT_SAMPLES);
+	BenchStart();
+	RTPlotDrawTraces(plot, data, PLOT_SAMPLES);
+}
+
+/* Same sweep with a spans table, the frame memory must match the full column
+ * version left in it */
+static void PlotSpansSweep(plot_t *plot, const int16_t *data, const char *name){
+	static uint16_t full_frame[FRAME_SIZE][FRAME_SIZE];
+	static plot_span_t spans[FRAME_SIZE];
+	bench_result_t result;
+
+	memcpy(full_frame, frame, sizeof(frame));
+	plot->spans = spans;
+	PlotSweep(plot, data);
+	BenchEnd(&result);
+	BenchPrint(name, &result);
+	if (memcmp(full_frame, frame, sizeof(frame)) != 0){
+		printf("%s differs from the full column version\n", name);
+		compare_failed++;
+	}
+}
+
+int main(int argc, char **argv){
+	static int16_t traces[PLOT_SAMPLES * 3];
+	bench_result_t result;
+
+	if (argc > 1){
+		t_transaction_us = atof(argv[1]);
+	}
+	ILI9341Init(LCD_SPI, GPIO_9, GPIO_18);
+	ILI9341Rotate(ILI9341_Portrait_1);
+	MakePictures();
+	MakeTraces(traces, PLOT_SAMPLES);
+
+	printf("T_TRANSACTION = %.2f us\n\n", t_transaction_us);
+	printf("%-22s %8s %8s %10s %10s %10s %6s %6s %6s\n", "primitive", "trans", "bytes",
+			"time_us", "wire_us", "model_us", "poll", "intr", "queue");
+	BENCH("Fill", ILI9341Fill(ILI9341_NAVY));
+	BENCH("DrawFilledRect 50x50", ILI9341DrawFilledRectangle(10, 10, 59, 59, ILI9341_YELLOW));
+	BENCH("DrawChar 11x18", ILI9341DrawChar(10, 80, 'A', &font_11x18, ILI9341_BLACK, ILI9341_WHITE));
+	BENCH("DrawString 10x 11x18", ILI9341DrawString(10, 100, "0123456789", &font_11x18, ILI9341_BLACK, ILI9341_WHITE));
+	BENCH("DrawInt 3 dig 16x26", ILI9341DrawInt(10, 120, 123, 3, &font_16x26, ILI9341_BLACK, ILI9341_WHITE));
+	BENCH("DrawLine horiz 200", ILI9341DrawLine(20, 160, 219, 160, ILI9341_RED));
+	BENCH("DrawLine vert 200", ILI9341DrawLine(20, 100, 20, 299, ILI9341_RED));
+	BENCH("DrawLine shallow", ILI9341DrawLine(20, 170, 219, 200, ILI9341_RED));
+	BENCH("DrawLine diagonal", ILI9341DrawLine(20, 100, 219, 299, ILI9341_RED));
+	BENCH("DrawRectangle 100x100", ILI9341DrawRectangle(70, 110, 169, 209, ILI9341_BLUE));
+	BENCH("DrawCircle r50", ILI9341DrawCircle(120, 160, 50, ILI9341_GREEN));
+	BENCH("DrawFilledCircle r50", ILI9341DrawFilledCircle(120, 160, 50, ILI9341_GREEN));
+	BENCH("DrawTriangle", ILI9341DrawTriangle(20, 300, 120, 200, 220, 300, ILI9341_MAGENTA));
+	BENCH("DrawFilledTriangle", ILI9341DrawFilledTriangle(20, 300, 120, 200, 220, 300, ILI9341_MAGENTA));
+	BENCH("DrawPicture 52x45", ILI9341DrawPicture(180, 10, PIC_WIDTH, PIC_HEIGHT, picture));
+	BENCH("DrawRlePicture 52x45", ILI9341DrawRlePicture(180, 60, PIC_WIDTH, PIC_HEIGHT, picture_rle));
+
+	/* Span versions against the pixel by pixel ones */
+	printf("\n%-22s %10s %10s %8s %8s %8s %8s\n", "shape", "ref_trans", "ref_bytes", "trans", "bytes",
+			"pixels", "differ");
+	COMPARE("DrawLine shallow", RefDrawLine(20, 170, 219, 200, ILI9341_RED),
+			ILI9341DrawLine(20, 170, 219, 200, ILI9341_RED));
+	COMPARE("DrawLine steep", RefDrawLine(30, 20, 60, 300, ILI9341_RED),
+			ILI9341DrawLine(30, 20, 60, 300, ILI9341_RED));
+	COMPARE("DrawLine diagonal", RefDrawLine(20, 100, 219, 299, ILI9341_RED),
+			ILI9341DrawLine(20, 100, 219, 299, ILI9341_RED));
+	COMPARE("DrawLine backwards", RefDrawLine(219, 200, 20, 170, ILI9341_RED),
+			ILI9341DrawLine(219, 200, 20, 170, ILI9341_RED));
+	COMPARE("DrawRectangle 100x100", RefDrawRectangle(70, 110, 169, 209, ILI9341_BLUE),
+			ILI9341DrawRectangle(70, 110, 169, 209, ILI9341_BLUE));
+	COMPARE("DrawCircle r50", RefDrawCircle(120, 160, 50, ILI9341_GREEN, false),
+			ILI9341DrawCircle(120, 160, 50, ILI9341_GREEN));
+	COMPARE("DrawCircle r7", RefDrawCircle(120, 160, 7, ILI9341_GREEN, false),
+			ILI9341DrawCircle(120, 160, 7, ILI9341_GREEN));
+	COMPARE("DrawFilledCircle r50", RefDrawCircle(120, 160, 50, ILI9341_GREEN, true),
+			ILI9341DrawFilledCircle(120, 160, 50, ILI9341_GREEN));
+	COMPARE("DrawTriangle", RefDrawTriangle(20, 300, 120, 200, 220, 300, ILI9341_MAGENTA),
+			ILI9341DrawTriangle(20, 300, 120, 200, 220, 300, ILI9341_MAGENTA));
+
+	/* Rolling plot, one sweep of 3 traces */
+	printf("\n");
+	plot_t plot = {.x_pos = 0, .y_pos = 160, .width = 240, .height = 100, .x_scale = 38,
+			.back_color = ILI9341_WHITE};
+	PlotSweep(&plot, traces);
+	BenchEnd(&result);
+	BenchPrint("Plot 240x100", &result);
+	PlotSpansSweep(&plot, traces, "Plot 240x100 spans");
+
+	ILI9341Rotate(ILI9341_Landscape_1);
+	plot = (plot_t){.x_pos = 0, .y_pos = 0, .width = 240, .height = 239, .x_scale = 38,
+			.back_color = ILI9341_WHITE, .hw_scroll = true};
+	PlotSweep(&plot, traces);
+	BenchEnd(&result);
+	BenchPrint("Plot scroll 240x240", &result);
+	PlotSpansSweep(&plot, traces, "Plot scroll spans");
+
+	if (compare_failed != 0){
+		printf("\n%u shape(s) differ from the pixel by pixel version\n", compare_failed);
+	}
+	return compare_failed != 0;
+}
@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""
+@file img_pack.py
+@brief Packs RGB565 pictures in the RLE format read by ILI9341DrawRlePicture
+
+The compressed stream is a sequence of packets. Each one starts with a control
+byte c:
+  - c & 0x80: run, the next 2 bytes (RGB565, high byte first) are repeated
+    (c & 0x7F) + 1 times.
+  - otherwise: literal, the next (c + 1) * 2 bytes are c + 1 pixels.
+Packets are not aligned to rows, the picture is a single raster stream.
+
+The input can be a picture file (requires Pillow) or a C file/header with a raw
+"65K Color (2 bytes/pixel)" array, as produced by the digole converter used for
+the pictures already in the repository. The doc comment of a C input (author,
+copyright, original tool) is kept in the generated header.
+
+Usage:
+  img_pack.py heart.png -n heart -o heart_pic.h
+  img_pack.py heart_pic.h -W 52 -H 45 -n heart -o heart_pic.h
+"""
+
+import argparse
+import re
+import sys
+
+MAX_RUN = 128       # (c & 0x7F) + 1
+MAX_LITERAL = 128   # c + 1, with c < 0x80
+
+
+def read_picture(path):
+    """Returns (width, height, pixels) from a picture file"""
+    from PIL import Image
+    img = Image.open(path).convert("RGB")
+    pixels = []
+    for r, g, b in img.getdata():
+        pixels.append(((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3))
+    return img.width, img.height, pixels
+
+
+def read_c_array(path):
+    """Returns the pixels of the first byte array of a C file"""
+    text = open(path).read()
+    body = text[text.index("{") + 1:text.index("}")]
+    data = [int(v, 16) for v in re.findall(r"0x[0-9a-fA-F]{1,2}", body)]
+    if len(data) % 2:
+        sys.exit("odd number of bytes in " + path)
+    return [(data[i] << 8) | data[i + 1] for i in range(0, len(data), 2)]
+
+
+def read_c_comment(path):
+    """Returns the lines inside the leading doc comment of a C file, or None"""
+    text = open(path).read().lstrip()
+    if not text.startswith("/**") or "*/" not in text:
+        return None
+    lines = text[:text.index("*/")].rstrip().split("\n")[1:]
+    return [line.rstrip() for line in lines]
+
+
+def rle_encode(pixels):
+    """Encodes a list of RGB565 pixels"""
+    out = bytearray()
+    literal = []
+
+    def flush_literal():
+        while literal:
+            chunk = literal[:MAX_LITERAL]
+            del literal[:MAX_LITERAL]
+            out.append(len(chunk) - 1)
+            for p in chunk:
+                out.extend((p >> 8, p & 0xFF))
+
+    i = 0
+    while i < len(pixels):
+        run = 1
+        while i + run < len(pixels) and run < MAX_RUN and pixels[i + run] == pixels[i]:
+            run += 1
+        # A run of 2 costs the same as a literal, keep it in the literal
+        if run >= 3:
+            flush_literal()
+            out.append(0x80 | (run - 1))
+            out.extend((pixels[i] >> 8, pixels[i] & 0xFF))
+        else:
+            literal.extend(pixels[i:i + run])
+        i += run
+    flush_literal()
+    return out
+
+
+def rle_decode(data):
+    """Decodes a RLE stream, used to check the encoder output"""
+    pixels = []
+    i = 0
+    while i < len(data):
+        c = data[i]
+        i += 1
+        if c & 0x80:
+            pixels += [(data[i] << 8) | data[i + 1]] * ((c & 0x7F) + 1)
+            i += 2
+        else:
+            for _ in range(c + 1):
+                pixels.append((data[i] << 8) | data[i + 1])
+                i += 2
+    return pixels
+
+
+def write_header(path, name, width, height, data, raw_size, comment=None):
+    guard = name.upper()
+    brief = " * @brief Picture \"" + name + "\" in RLE format (see ILI9341DrawRlePicture)"
+    note = " * @note Packed with firmware/tools/img_pack.py: %d bytes (raw: %d bytes)" % (len(data), raw_size)
+    if comment:
+        # Keep the original comment, the note goes after its last @note
+        comment = [line for line in comment if "img_pack.py" not in line]
+        notes = [i for i, line in enumerate(comment) if "@note" in line]
+        at = notes[-1] + 1 if notes else len(comment)
+        comment = comment[:at] + [note] + comment[at:]
+    else:
+        comment = [" * @file " + path.split("/")[-1], brief, note]
+    lines = ["/**"] + comment + [
+             " */",
+             "#include <stdint.h>",
+             "",
+             "#define %s_WIDTH     %d" % (guard, width),
+             "#define %s_HEIGHT    %d" % (guard, height),
+             "",
+             "const uint8_t %s[] = {" % name]
+    for i in range(0, len(data), 16):
+        lines.append("    " + ",".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    lines[-1] = lines[-1][:-1]
+    lines.append("};")
+    open(path, "w").write("\n".join(lines) + "\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    parser.add_argument("input", help="picture file, or C file with a raw RGB565 array")
+    parser.add_argument("-n", "--name", required=True, help="name of the C array")
+    parser.add_argument("-o", "--output", required=True, help="header to create")
+    parser.add_argument("-W", "--width", type=int, help="width, for C array inputs")
+    parser.add_argument("-H", "--height", type=int, help="height, for C array inputs")
+    args = parser.parse_args()
+
+    if args.input.endswith((".c", ".h")):
+        if not args.width or not args.height:
+            sys.exit("width and height are needed for C array inputs")
+        width, height = args.width, args.height
+        pixels = read_c_array(args.input)
+        comment = read_c_comment(args.input)
+    else:
+        width, height, pixels = read_picture(args.input)
+        comment = None
+    if len(pixels) != width * height:
+        sys.exit("%d pixels, expected %d" % (len(pixels), width * height))
+
+    data = rle_encode(pixels)
+    if rle_decode(data) != pixels:
+        sys.exit("encoder error")
+    write_header(args.output, args.name, width, height, data, len(pixels) * 2, comment)
+    print("%s: %d -> %d bytes" % (args.output, len(pixels) * 2, len(data)))
+
+
+if __name__ == "__main__":
+    main()
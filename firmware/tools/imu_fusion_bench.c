@@ -0,0 +1,163 @@
+/**
+ * @file imu_fusion_bench.c
+ * @brief Host benchmark and check of the fixed point IMU fusion
+ *
+ * Feeds a synthetic motion (sinusoidal rotation on the three axes, MPU6050
+ * counts at 1 kHz, +-2 g and +-250 dps) to ImuFusionUpdate and to a floating
+ * point Mahony filter with the same gains, and reports the largest difference
+ * between both quaternions and the cost of an update (ns, and cycles on x86).
+ * A shock that saturates the three accelerometer axes is checked the same way.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -Ifirmware/drivers/devices/inc firmware/tools/imu_fusion_bench.c \
+ *       firmware/drivers/devices/src/imu_fusion.c -lm -o imu_fusion_bench
+ *   ./imu_fusion_bench
+ *
+ * On target, projects/imu_fusion_benchmark reports the cycles per update.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "imu_fusion.h"
+
+#define RATE_HZ			1000
+#define SECONDS			60
+#define SAMPLES			(RATE_HZ * SECONDS)
+#define ACCEL_LSB_G		16384.0		/* +-2 g */
+#define GYRO_LSB_DPS	131.0		/* +-250 dps */
+#define DEG_TO_RAD		(M_PI / 180.0)
+#define SHOCK_SAMPLES	200			/* Saturated accelerometer, 200 ms */
+
+static int16_t data[SAMPLES][6];
+
+/* Floating point Mahony, reference for the fixed point version */
+static double fq[4] = {1, 0, 0, 0};
+static void FloatUpdate(const int16_t accel[3], const int16_t gyro[3], double two_kp){
+	double gx = gyro[0] / GYRO_LSB_DPS * DEG_TO_RAD, gy = gyro[1] / GYRO_LSB_DPS * DEG_TO_RAD;
+	double gz = gyro[2] / GYRO_LSB_DPS * DEG_TO_RAD;
+	double ax = accel[0], ay = accel[1], az = accel[2];
+	double norm = sqrt(ax * ax + ay * ay + az * az);
+	double q0 = fq[0], q1 = fq[1], q2 = fq[2], q3 = fq[3];
+
+	if (norm > 0){
+		ax /= norm; ay /= norm; az /= norm;
+		double vx = q1 * q3 - q0 * q2, vy = q0 * q1 + q2 * q3, vz = q0 * q0 - 0.5 + q3 * q3;
+		gx += two_kp * (ay * vz - az * vy);
+		gy += two_kp * (az * vx - ax * vz);
+		gz += two_kp * (ax * vy - ay * vx);
+	}
+	gx *= 0.5 / RATE_HZ; gy *= 0.5 / RATE_HZ; gz *= 0.5 / RATE_HZ;
+	fq[0] += -q1 * gx - q2 * gy - q3 * gz;
+	fq[1] += q0 * gx + q2 * gz - q3 * gy;
+	fq[2] += q0 * gy - q1 * gz + q3 * gx;
+	fq[3] += q0 * gz + q1 * gy - q2 * gx;
+	norm = sqrt(fq[0] * fq[0] + fq[1] * fq[1] + fq[2] * fq[2] + fq[3] * fq[3]);
+	for (int i = 0; i < 4; i++){
+		fq[i] /= norm;
+	}
+}
+
+/* Body rates and the gravity they produce, integrating the true orientation */
+static void MakeMotion(void){
+	double q[4] = {1, 0, 0, 0};
+	for (int k = 0; k < SAMPLES; k++){
+		double t = (double)k / RATE_HZ;
+		double w[3] = {60 * sin(2 * M_PI * 0.3 * t), 45 * sin(2 * M_PI * 0.17 * t + 1), 90 * sin(2 * M_PI * 0.05 * t)};
+		/* Gravity in the body frame: conjugate rotation of (0, 0, 1) */
+		double gx = 2 * (q[1] * q[3] - q[0] * q[2]);
+		double gy = 2 * (q[0] * q[1] + q[2] * q[3]);
+		double gz = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+		data[k][0] = (int16_t)lround(gx * ACCEL_LSB_G);
+		data[k][1] = (int16_t)lround(gy * ACCEL_LSB_G);
+		data[k][2] = (int16_t)lround(gz * ACCEL_LSB_G);
+		for (int i = 0; i < 3; i++){
+			data[k][3 + i] = (int16_t)lround(w[i] * GYRO_LSB_DPS);
+		}
+		double h = 0.5 / RATE_HZ * DEG_TO_RAD;
+		double q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+		q[0] += h * (-q1 * w[0] - q2 * w[1] - q3 * w[2]);
+		q[1] += h * (q0 * w[0] + q2 * w[2] - q3 * w[1]);
+		q[2] += h * (q0 * w[1] - q1 * w[2] + q3 * w[0]);
+		q[3] += h * (q0 * w[2] + q1 * w[1] - q2 * w[0]);
+		double n = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+		for (int i = 0; i < 4; i++){
+			q[i] /= n;
+		}
+	}
+}
+
+int main(void){
+	imu_fusion_t fusion;
+	imu_euler_t euler;
+	struct timespec t0, t1;
+	double err, max_err = 0, ns;
+	uint64_t cycles = 0;
+
+	MakeMotion();
+
+	/* Accuracy against the floating point filter */
+	ImuFusionInit(&fusion, RATE_HZ, 0, IMU_FUSION_KP, 0);
+	for (int k = 0; k < SAMPLES; k++){
+		ImuFusionUpdate(&fusion, &data[k][0], &data[k][3]);
+		FloatUpdate(&data[k][0], &data[k][3], 2 * IMU_FUSION_KP);
+		err = 0;
+		for (int i = 0; i < 4; i++){
+			err += fabs(fusion.q[i] / 1073741824.0 - fq[i]);
+		}
+		if (err > max_err){
+			max_err = err;
+		}
+	}
+	ImuFusionGetEuler(&fusion, &euler);
+	printf("max |q_fixed - q_float| (sum of 4 components): %.2e\n", max_err);
+	printf("euler fixed: roll %.2f pitch %.2f yaw %.2f deg\n", euler.roll / 100.0, euler.pitch / 100.0, euler.yaw / 100.0);
+	printf("euler float: roll %.2f pitch %.2f yaw %.2f deg\n",
+			atan2(fq[0] * fq[1] + fq[2] * fq[3], 0.5 - fq[1] * fq[1] - fq[2] * fq[2]) / DEG_TO_RAD,
+			asin(2 * (fq[0] * fq[2] - fq[1] * fq[3])) / DEG_TO_RAD,
+			atan2(fq[0] * fq[3] + fq[1] * fq[2], 0.5 - fq[2] * fq[2] - fq[3] * fq[3]) / DEG_TO_RAD);
+
+	/* Shock: the three accelerometer axes saturated, the largest norm possible */
+	static const int16_t shock[2][3] = {{-32768, -32768, -32768}, {32767, 32767, 32767}};
+	static const int16_t still[3] = {0, 0, 0};
+	for (int s = 0; s < 2; s++){
+		ImuFusionInit(&fusion, RATE_HZ, 0, IMU_FUSION_KP, 0);
+		fq[0] = 1; fq[1] = fq[2] = fq[3] = 0;
+		max_err = 0;
+		for (int k = 0; k < SHOCK_SAMPLES; k++){
+			ImuFusionUpdate(&fusion, shock[s], still);
+			FloatUpdate(shock[s], still, 2 * IMU_FUSION_KP);
+			err = 0;
+			for (int i = 0; i < 4; i++){
+				err += fabs(fusion.q[i] / 1073741824.0 - fq[i]);
+			}
+			if (err > max_err){
+				max_err = err;
+			}
+		}
+		printf("shock (%d, %d, %d): max |q_fixed - q_float| %.2e\n", shock[s][0], shock[s][1], shock[s][2], max_err);
+	}
+
+	/* Cost of an update, the whole recording as a single batch */
+	ImuFusionInit(&fusion, RATE_HZ, 0, IMU_FUSION_KP, 0);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+#if defined(__x86_64__) || defined(__i386__)
+	cycles = __rdtsc();
+#endif
+	ImuFusionUpdateBatch(&fusion, &data[0][0], SAMPLES, sizeof(data[0]));
+#if defined(__x86_64__) || defined(__i386__)
+	cycles = __rdtsc() - cycles;
+#endif
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+	printf("update: %.1f ns", ns / SAMPLES);
+	if (cycles != 0){
+		printf(", %.1f TSC cycles", (double)cycles / SAMPLES);
+	}
+	printf(" (%d samples, q0 = %ld)\n", SAMPLES, (long)fusion.q[0]);
+	return 0;
+}
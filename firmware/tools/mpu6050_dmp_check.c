@@ -0,0 +1,115 @@
+/**
+ * @file mpu6050_dmp_check.c
+ * @brief Host check of the MPU6050 DMP packet parser
+ *
+ * Decodes a set of reference packets (both layouts, at rest and rotated, and
+ * the misaligned and wrong size cases) with MPU6050_dmpParsePacket and compares
+ * the result with the expected values. Packets captured from the FIFO can be
+ * decoded too, passing them in hex as arguments (28 or 42 bytes each).
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -Ifirmware/drivers/devices/inc firmware/tools/mpu6050_dmp_check.c \
+ *       firmware/drivers/devices/src/mpu6050_dmp.c -o mpu6050_dmp_check
+ *   ./mpu6050_dmp_check [packet_hex ...]
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "mpu6050_dmp.h"
+
+typedef struct {
+	const char *name;
+	uint8_t data[MPU6050_DMP_PACKET_MAX + 1];
+	uint8_t offset;					/* First byte passed to the parser */
+	uint8_t size;
+	bool valid;
+	mpu6050_dmp_packet_t expected;
+} reference_t;
+
+static const reference_t references[] = {
+	{
+		"6.12, flat at rest",
+		{0x3F, 0xFF, 0xE1, 0xA0, 0x00, 0x04, 0xB2, 0xC0, 0xFF, 0xFD, 0x0E, 0xC0, 0x00, 0x01, 0x3A, 0x80,
+		 0xFF, 0xCC, 0x00, 0x76, 0x3F, 0xAE, 0xFF, 0xFD, 0x00, 0x01, 0x00, 0x00},
+		0, MPU6050_DMP_PACKET_612, true,
+		{{0x3FFFE1A0, 0x0004B2C0, -0x0002F140, 0x00013A80}, {-52, 118, 16302}, {-3, 1, 0}}
+	},
+	{
+		"2.0, rolled 90 degrees",
+		{0x2D, 0x41, 0x3C, 0xCC, 0x2D, 0x41, 0x3C, 0xCC, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		 0x00, 0x02, 0x12, 0x34, 0xFF, 0xFF, 0x12, 0x34, 0x00, 0x00, 0x12, 0x34, 0x00, 0x23, 0x0A, 0xBC,
+		 0x3F, 0xA2, 0x0A, 0xBC, 0xFF, 0x2E, 0x0A, 0xBC, 0x00, 0x00},
+		0, MPU6050_DMP_PACKET_20, true,
+		{{0x2D413CCC, 0x2D413CCC, 0, 0}, {35, 16290, -210}, {2, -1, 0}}
+	},
+	{
+		"6.12, one byte late",
+		{0x3F, 0xFF, 0xE1, 0xA0, 0x00, 0x04, 0xB2, 0xC0, 0xFF, 0xFD, 0x0E, 0xC0, 0x00, 0x01, 0x3A, 0x80,
+		 0xFF, 0xCC, 0x00, 0x76, 0x3F, 0xAE, 0xFF, 0xFD, 0x00, 0x01, 0x00, 0x00, 0x3F},
+		1, MPU6050_DMP_PACKET_612, false, {{0}, {0}, {0}}
+	},
+	{
+		"6.12, starting at the accel",
+		{0xFF, 0xCC, 0x00, 0x76, 0x3F, 0xAE, 0xFF, 0xFD, 0x00, 0x01, 0x00, 0x00, 0x3F, 0xFF, 0xE1, 0xA0,
+		 0x00, 0x04, 0xB2, 0xC0, 0xFF, 0xFD, 0x0E, 0xC0, 0x00, 0x01, 0x3A, 0x80},
+		0, MPU6050_DMP_PACKET_612, false, {{0}, {0}, {0}}
+	},
+	{
+		"unknown size",
+		{0x3F, 0xFF, 0xE1, 0xA0},
+		0, 30, false, {{0}, {0}, {0}}
+	},
+};
+
+static void Print(const mpu6050_dmp_packet_t *p){
+	printf("  q = (%.5f, %.5f, %.5f, %.5f) accel = (%d, %d, %d) gyro = (%d, %d, %d)\n",
+			p->q[0] / 1073741824.0, p->q[1] / 1073741824.0, p->q[2] / 1073741824.0, p->q[3] / 1073741824.0,
+			p->accel[0], p->accel[1], p->accel[2], p->gyro[0], p->gyro[1], p->gyro[2]);
+}
+
+static int Hex(char c){
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+int main(int argc, char **argv){
+	mpu6050_dmp_packet_t packet;
+	uint8_t data[MPU6050_DMP_PACKET_MAX];
+	unsigned failed = 0;
+	size_t i, len;
+	bool valid;
+
+	for (i = 0; i < sizeof(references) / sizeof(references[0]); i++){
+		const reference_t *r = &references[i];
+		memset(&packet, 0, sizeof(packet));
+		valid = MPU6050_dmpParsePacket(&r->data[r->offset], r->size, &packet);
+		bool ok = (valid == r->valid) &&
+				(!valid || memcmp(&packet, &r->expected, sizeof(packet)) == 0);
+		printf("%-30s %s\n", r->name, ok ? "ok" : "FAILED");
+		if (!ok){
+			failed++;
+			Print(&packet);
+		}
+	}
+
+	/* Captured packets */
+	for (int a = 1; a < argc; a++){
+		len = strlen(argv[a]) / 2;
+		if (len > sizeof(data)){
+			len = sizeof(data);
+		}
+		for (i = 0; i < len; i++){
+			data[i] = (Hex(argv[a][2 * i]) << 4) | Hex(argv[a][2 * i + 1]);
+		}
+		valid = MPU6050_dmpParsePacket(data, len, &packet);
+		printf("argument %d (%zu bytes): %s\n", a, len, valid ? "valid" : "rejected");
+		if (valid){
+			Print(&packet);
+		}
+	}
+
+	printf("%u reference packet(s) failed\n", failed);
+	return failed != 0;
+}